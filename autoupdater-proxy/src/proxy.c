@@ -8,6 +8,8 @@
 #include <sys/stat.h>
 #include <sys/file.h>
 #include <libubox/uloop.h>
+#include <footprint.h>
+#include <hexutil.h>
 #include <time.h>
 
 #include "fetch.h"
@@ -26,11 +28,13 @@ static ssize_t query_string_decode_value(char* value) {
 			continue;
 		}
 
-		if(limit - search_pos < 2) {
+		if(limit - search_pos < 3) {
 			return -EINVAL;
 		}
 
-		*search_pos = hex_to_byte(search_pos + 1);
+		if(!hexdecode(search_pos, search_pos + 1, 1)) {
+			return -EINVAL;
+		}
 		search_pos++;
 		limit -= 2;
 		memmove(search_pos, search_pos + 2, limit - search_pos);
@@ -204,5 +208,12 @@ out_lockfd:
 	if(lockfd >= 0) {
 		close(lockfd);
 	}
+
+	/* uhttpd logs what CGI programs write to stderr, so only when asked for */
+	struct footprint fp;
+	if(getenv("MIAU_PROXY_FOOTPRINT") && footprint_read(&fp)) {
+		fprintf(stderr, "Peak RSS %lu KiB, peak virtual memory %lu KiB, CPU %.3f s user, %.3f s system\n",
+			fp.rss_peak, fp.vm_peak, fp.cpu_user, fp.cpu_system);
+	}
 	return err;
 }
@@ -8,16 +8,6 @@ void strntr(char* str, size_t len, char a, char b);
 #define strtr(str, a, b) \
 	strntr(str, strlen(str), a, b);
 
-#define hex_to_nibble(hex) \
-	(((hex) >= '0' && (hex) <= '9' ? (uint8_t)((hex) - '0') : \
-		(hex) >= 'A' && (hex) <= 'F' ? (uint8_t)((hex) - 'A' + 0xA) : \
-			(hex) >= 'a' && (hex) <= 'f' ? (uint8_t)((hex) - 'a' + 0xA) : \
-				0 \
-	) & 0xF)
-
-#define hex_to_byte(hex) \
-	((hex_to_nibble((hex)[0]) << 4) | hex_to_nibble((hex)[1]))
-
 #define ARRAY_SHUFFLE(arr, len) \
 	{ \
 		typeof((len)) i, j; \
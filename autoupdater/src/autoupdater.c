@@ -26,12 +26,26 @@
 */
 
 
+#include "backoff.h"
+#include "binfetch.h"
+#include "cache.h"
+#include "daemon.h"
+#include "hash.h"
+#include "history.h"
+#include "hooks.h"
 #include "manifest.h"
+#include "neighbour.h"
+#include "pipeline.h"
 #include "settings.h"
+#include "status.h"
+#include "storage.h"
+#include "trace.h"
 #include "uclient.h"
 #include "util.h"
+#include "verify.h"
 #include "version.h"
 
+#include <hexutil.h>
 #include <libmeshneighbour.h>
 #include <librespondd.h>
 #include <libplatforminfo.h>
@@ -39,12 +53,13 @@
 #include <libubox/list.h>
 #include <libubus.h>
 #include <ecdsautil/ecdsa.h>
-#include <ecdsautil/sha256.h>
 #include <json-c/json.h>
 
+#include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -59,29 +74,25 @@
 #include <arpa/inet.h>
 
 
-#define MAX_LINE_LENGTH 512
+#define MANIFEST_CHUNK 4096
 #define MAX_URL_LENGTH 256
 
-
-#define STRINGIFY(str) #str
-
 static const char *const download_d_dir = "/usr/lib/autoupdater/download.d";
 static const char *const abort_d_dir = "/usr/lib/autoupdater/abort.d";
 static const char *const upgrade_d_dir = "/usr/lib/autoupdater/upgrade.d";
 static const char *const lockfile = "/var/lock/autoupdater.lock";
-static const char *const firmware_path = "/tmp/firmware.bin";
 static const char *const sysupgrade_path = "/sbin/sysupgrade";
 
 struct recv_manifest_ctx {
 	struct settings *s;
 	struct manifest m;
-	char buf[MAX_LINE_LENGTH + 1];
-	char *ptr;
+	struct manifest_parser parser;
 };
 
 struct recv_image_ctx {
 	int fd;
-	ecdsa_sha256_context_t hash_ctx;
+	struct hash_ctx hash_ctx;
+	struct pipeline pipeline;
 };
 
 struct updater_url_fmt {
@@ -97,6 +108,9 @@ static void usage(void) {
 		"Usage: autoupdater [options] [<mirror> ...]\n\n"
 		"Possible options are:\n"
 		"  -b, --branch BRANCH  Override the branch given in the configuration.\n\n"
+		"  -d, --daemon         Keep running and check for updates periodically, when\n"
+		"                       the WAN interface comes up and when requested via\n"
+		"                       ubus (autoupdater.check).\n\n"
 		"  -f, --force          Always upgrade to a new version, ignoring its priority\n"
 		"                       and whether the autoupdater even is enabled.\n\n"
 		"  -h, --help           Show this help.\n\n"
@@ -115,6 +129,7 @@ static void usage(void) {
 static void parse_args(int argc, char *argv[], struct settings *settings) {
 	enum option_values {
 		OPTION_BRANCH = 'b',
+		OPTION_DAEMON = 'd',
 		OPTION_FORCE = 'f',
 		OPTION_HELP = 'h',
 		OPTION_NO_ACTION = 'n',
@@ -124,6 +139,7 @@ static void parse_args(int argc, char *argv[], struct settings *settings) {
 
 	const struct option options[] = {
 		{"branch",    required_argument, NULL, OPTION_BRANCH},
+		{"daemon",    no_argument,       NULL, OPTION_DAEMON},
 		{"force",     no_argument,       NULL, OPTION_FORCE},
 		{"fallback",  no_argument,       NULL, OPTION_FALLBACK},
 		{"no-action", no_argument,       NULL, OPTION_NO_ACTION},
@@ -132,7 +148,7 @@ static void parse_args(int argc, char *argv[], struct settings *settings) {
 	};
 
 	while (true) {
-		int c = getopt_long(argc, argv, "b:fhn", options, NULL);
+		int c = getopt_long(argc, argv, "b:dfhn", options, NULL);
 		if (c < 0)
 			break;
 
@@ -141,6 +157,10 @@ static void parse_args(int argc, char *argv[], struct settings *settings) {
 			settings->branch = optarg;
 			break;
 
+		case OPTION_DAEMON:
+			settings->daemon = true;
+			break;
+
 		case OPTION_FORCE:
 			settings->force = true;
 			break;
@@ -178,7 +198,7 @@ static void parse_args(int argc, char *argv[], struct settings *settings) {
 }
 
 
-static float get_probability(time_t date, float priority, bool fallback) {
+static float get_probability(time_t date, float priority, bool fallback, bool uniform) {
 	float seconds = priority * 86400;
 	time_t diff = time(NULL) - date;
 
@@ -217,6 +237,10 @@ static float get_probability(time_t date, float priority, bool fallback) {
 	else {
 		float x = diff/seconds;
 
+		/* Rollout slots are spread evenly over the update window */
+		if (uniform)
+			return x;
+
 		/*
 		 This is the simplest polynomial with value 0 at 0, 1 at 1, and which has a
 		 first derivative of 0 at both 0 and 1 (we all love continuously differentiable
@@ -227,67 +251,71 @@ static float get_probability(time_t date, float priority, bool fallback) {
 }
 
 
-/** Receives data from uclient, chops it to lines and hands it to \ref parse_line */
+/**
+ * Decides whether it is this node's turn to update. By default every run
+ * flips a coin weighted with the update probability. With rollout slots,
+ * every node gets a fixed slot in the update window derived from its node
+ * ID, so the updates of the whole fleet are spread evenly over the window.
+ */
+static bool rollout_due(const struct settings *s, const struct manifest *m) {
+	if (!s->rollout_slots)
+		return random() < RAND_MAX * get_probability(m->date, m->priority, s->fallback, false);
+
+	float slot = get_node_hash() / 4294967296.0f;
+	return get_probability(m->date, m->priority, s->fallback, true) > slot;
+}
+
+
+/** Receives data from uclient and hands it to the manifest parser */
 static void recv_manifest_cb(struct uclient *cl) {
 	struct recv_manifest_ctx *ctx = uclient_get_custom(cl);
-	char *newline;
+	char buf[MANIFEST_CHUNK];
 	int len;
 
-	while (true) {
-		if (ctx->ptr - ctx->buf == MAX_LINE_LENGTH) {
-			fputs("autoupdater: error: encountered manifest line exceeding limit of " STRINGIFY(MAX_LINE_LENGTH) " characters\n", stderr);
-			break;
-		}
-		len = uclient_read_account(cl, ctx->ptr, MAX_LINE_LENGTH - (ctx->ptr - ctx->buf));
-		if (len <= 0)
-			break;
-		ctx->ptr[len] = '\0';
+	while ((len = uclient_read_account(cl, buf, sizeof(buf))) > 0)
+		manifest_parser_feed(&ctx->parser, buf, len);
+}
+
 
-		char *line = ctx->buf;
-		while (true) {
-			newline = strchr(line, '\n');
-			if (newline == NULL)
-				break;
-			*newline = '\0';
+/** Writes a chunk of the image to file and adds it to the checksum, runs on the pipeline worker */
+static int image_sink(const void *buf, size_t len, void *priv) {
+	struct recv_image_ctx *ctx = priv;
+	const char *ptr = buf;
 
-			parse_line(line, &ctx->m, ctx->s->branch, platforminfo_get_image_name());
-			line = newline + 1;
+	hash_update(&ctx->hash_ctx, buf, len);
+
+	while (len) {
+		ssize_t written = write(ctx->fd, ptr, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
 		}
 
-		// Move the beginning of the next line to the beginning of the
-		// buffer. We cannot use strcpy here because the memory areas
-		// might overlap!
-		int n = strlen(line);
-		memmove(ctx->buf, line, n);
-		ctx->ptr = ctx->buf + n;
+		ptr += written;
+		len -= written;
 	}
+
+	return 0;
 }
 
 
-/** Receives data from uclient and writes it to file */
+/** Receives data from uclient and hands it to the image pipeline */
 static void recv_image_cb(struct uclient *cl) {
 	struct recv_image_ctx *ctx = uclient_get_custom(cl);
-	char buf[1024];
+	size_t space;
 	int len;
 
 	while (true) {
-		len = uclient_read_account(cl, buf, sizeof(buf));
+		char *buf = pipeline_buffer(&ctx->pipeline, &space);
+		len = uclient_read_account(cl, buf, space);
 		if (len <= 0)
 			return;
 
-		printf(
-			"\rDownloading image: % 5zi / %zi KiB",
-			uclient_data(cl)->downloaded / 1024,
-			uclient_data(cl)->length / 1024
-		);
-		fflush(stdout);
+		status_progress(uclient_data(cl)->downloaded, uclient_data(cl)->length);
 
-		if (write(ctx->fd, buf, len) < len) {
-			fputs("autoupdater: error: downloading firmware image failed: ", stderr);
-			perror(NULL);
+		if (pipeline_commit(&ctx->pipeline, len))
 			return;
-		}
-		ecdsa_sha256_update(&ctx->hash_ctx, buf, len);
 	}
 }
 
@@ -302,149 +330,15 @@ struct updater_url_ctx {
 	void *image_url_priv;
 };
 
-#define URL_CB_OK(ret, max_len) ({ const typeof((ret)) __ret = ret; ((__ret) >= 0 && (__ret) < (max_len)); })
-
-static bool autoupdate(struct settings *s, const struct updater_url_ctx *url_ctx, int lock_fd) {
-	bool ret = false;
-	struct recv_manifest_ctx manifest_ctx = { .s = s };
-	manifest_ctx.ptr = manifest_ctx.buf;
-	struct manifest *m = &manifest_ctx.m;
-
-	/**** Get and check manifest *****************************************/
-	/* Construct manifest URL */
-	char manifest_url[MAX_URL_LENGTH];
-	if(!URL_CB_OK(url_ctx->manifest_url_cb(manifest_url, MAX_URL_LENGTH, s, url_ctx->manifest_url_priv), MAX_URL_LENGTH)) {
-		goto out;
-	}
-
-	printf("Retrieving manifest from %s ...\n", manifest_url);
-
-	/* Download manifest */
-	ecdsa_sha256_init(&m->hash_ctx);
-	int err_code = get_url(manifest_url, recv_manifest_cb, &manifest_ctx, -1);
-	if (err_code != 0) {
-		fprintf(stderr, "autoupdater: warning: error downloading manifest: %s\n", uclient_get_errmsg(err_code));
-		goto out;
-	}
-
-	/* Check manifest signatures */
-	{
-		ecc_int256_t hash;
-		ecdsa_sha256_final(&m->hash_ctx, hash.p);
-		ecdsa_verify_context_t ctxs[m->n_signatures];
-		for (size_t i = 0; i < m->n_signatures; i++)
-			ecdsa_verify_prepare_legacy(&ctxs[i], &hash, m->signatures[i]);
-
-		long unsigned int good_signatures = ecdsa_verify_list_legacy(ctxs, m->n_signatures, s->pubkeys, s->n_pubkeys);
-		if (good_signatures < s->good_signatures) {
-			fprintf(stderr, "autoupdater: warning: manifest %s only carried %lu valid signatures, %lu are required\n", manifest_url, good_signatures, s->good_signatures);
-			goto out;
-		}
-	}
-
-	/* Check manifest */
-	if (!m->date_ok || !m->priority_ok) {
-		fprintf(stderr, "autoupdater: warning: manifest is missing mandatory fields\n");
-		goto out;
-	}
-
-	if (!m->branch_ok) {
-		fprintf(stderr, "autoupdater: warning: manifest %s is not for branch %s\n", manifest_url, s->branch);
-		goto out;
-	}
-
-	if (!m->model_ok) {
-		fprintf(stderr, "autoupdater: warning: no matching firmware found (model %s)\n", platforminfo_get_image_name());
-		goto out;
-	}
-
-	/* Check version and update probability */
-	if (!newer_than(m->version, s->old_version) && !s->force_version) {
-		puts("No new firmware available.");
-		ret = true;
-		goto out;
-	}
-
-	if (!s->force && random() >= RAND_MAX * get_probability(m->date, m->priority, s->fallback)) {
-		fputs("autoupdater: info: no autoupdate this time. Use -f to override.\n", stderr);
-		ret = true;
-		goto out;
-	}
-
-	/**** Download and verify image file *********************************/
-	/* Begin download of the image */
-	run_dir(download_d_dir);
-
-	struct recv_image_ctx image_ctx = { };
-	image_ctx.fd = open(firmware_path, O_WRONLY|O_CREAT, 0600);
-	if (image_ctx.fd < 0) {
-		fprintf(stderr, "autoupdater: error: failed opening firmware file %s\n", firmware_path);
-		goto fail_after_download;
-	}
-
-	/* Download image and calculate SHA256 checksum */
-	{
-		char image_url[MAX_URL_LENGTH];
-		if(!URL_CB_OK(url_ctx->image_url_cb(image_url, MAX_URL_LENGTH, s, m->image_filename, url_ctx->image_url_priv), MAX_URL_LENGTH)) {
-			goto fail_after_download;
-		}
-
-		printf("Downloading image from '%s'\n", image_url);
-
-		ecdsa_sha256_init(&image_ctx.hash_ctx);
-		int err_code = get_url(image_url, &recv_image_cb, &image_ctx, m->imagesize);
-		puts("");
-		if (err_code != 0) {
-			fprintf(stderr, "autoupdater: warning: error downloading image: %s\n", uclient_get_errmsg(err_code));
-			close(image_ctx.fd);
-			goto fail_after_download;
-		}
-	}
-	close(image_ctx.fd);
-
-	/* Verify image checksum */
-	{
-		ecc_int256_t hash;
-		ecdsa_sha256_final(&image_ctx.hash_ctx, hash.p);
-		if (memcmp(hash.p, m->image_hash, ECDSA_SHA256_HASH_SIZE)) {
-			fputs("autoupdater: warning: invalid image checksum!\n", stderr);
-			goto fail_after_download;
-		}
-	}
-
-	clear_manifest(m);
-
-	/**** Call sysupgrade ************************************************/
-	if (s->no_action) {
-		printf(
-			"autoupdater: info: Aborting successful upgrade because simulation was requested.\n"
-			"autoupdater: info: You can find the firmware file in %s\n",
-			firmware_path
-		);
-		run_dir(abort_d_dir);
-		ret = true;
-		goto out;
-	}
-
-	/* Begin upgrade */
-	run_dir(upgrade_d_dir);
+/** Checks whether a manifest with the given hash has already passed the signature check */
+static bool manifest_verified_before(const unsigned char hash[HASH_SIZE], const struct settings *s) {
+	struct manifest cached = { };
+	unsigned char cached_hash[HASH_SIZE];
 
-	/* Unset FD_CLOEXEC so the lockfile stays locked during sysupgrade */
-	fcntl(lock_fd, F_SETFD, 0);
+	bool ret = manifest_cache_load(&cached, cached_hash, s, platforminfo_get_image_name()) &&
+		   !memcmp(hash, cached_hash, HASH_SIZE);
 
-	execl(sysupgrade_path, sysupgrade_path, firmware_path, NULL);
-
-	/* execl() shouldn't return */
-	fputs("autoupdater: error: failed to call sysupgrade\n", stderr);
-
-	fcntl(lock_fd, F_SETFD, FD_CLOEXEC);
-
-fail_after_download:
-	unlink(firmware_path);
-	run_dir(abort_d_dir);
-
-out:
-	clear_manifest(m);
+	clear_manifest(&cached);
 	return ret;
 }
 
@@ -465,6 +359,10 @@ static int lock_autoupdater(void) {
 }
 
 static int respondd_mesh_cb(struct json_object *json_root, const struct librespondd_pkt_info *pktinfo, struct mesh_neighbour *neigh, void* priv) {
+	struct neighbour_info *info = safe_malloc(sizeof(*info));
+	*info = (struct neighbour_info){ .tq = -1 };
+	neigh->priv = info;
+
 	struct json_object *json_software;
 	if(!json_object_object_get_ex(json_root, "software", &json_software)) {
 		fputs("autoupdater: error: Failed to get software object form response, skipping\n", stderr);
@@ -484,7 +382,9 @@ static int respondd_mesh_cb(struct json_object *json_root, const struct librespo
 	}
 
 	const char *version_str = json_object_get_string(json_release);
-	neigh->priv = strdup(version_str);
+	info->version = strdup(version_str);
+	if (info->version)
+		version_key_init(&info->version_key, info->version);
 
 out:
 	return RESPONDD_CB_OK;
@@ -508,7 +408,7 @@ static int direct_image_url_cb(char *manifest_url, size_t url_len, const struct
 
 
 struct proxy_cb_priv {
-	const char *proxy_ll_addr;
+	char proxy_ll_addr[INET6_ADDRSTRLEN];
 	const char *proxy_iface;
 };
 
@@ -526,125 +426,817 @@ static int proxy_image_url_cb(char *image_url, size_t url_len, const struct sett
 		 proxy_priv->proxy_ll_addr, proxy_priv->proxy_iface, s->branch, image);
 }
 
-int main(int argc, char *argv[]) {
-	struct settings s = { };
-	parse_args(argc, argv, &s);
 
-	if (!platforminfo_get_image_name()) {
-		fputs("autoupdater: error: unsupported hardware model\n", stderr);
-		return EXIT_FAILURE;
-	}
+#define URL_CB_OK(ret, max_len) ({ const typeof((ret)) __ret = ret; ((__ret) >= 0 && (__ret) < (max_len)); })
 
-	bool external_mirrors = s.n_mirrors > 0;
-	load_settings(&s);
-	randomize();
+/* Maximum number of candidates the manifest is requested from at the same time */
+#define MANIFEST_PROBES 4
+/* Delay before the next candidate is tried while the previous ones are still busy */
+#define STAGGER_MSEC 2000
+/* Time budget for receiving a valid manifest from any candidate */
+#define RACE_DEADLINE_MSEC 120000
+
+#define RESPONDD_PORT 1001
+
+/* A source the manifest and the image can be fetched from */
+struct candidate {
+	/* identifies the candidate for backoff, see backoff.c */
+	const char *name;
+	/* requests to mirrors are logged, see history.c */
+	bool mirror;
+	struct updater_url_ctx url_ctx;
+	union {
+		struct direct_cb_priv direct;
+		struct proxy_cb_priv proxy;
+	} priv;
+};
 
-	int lock_fd = lock_autoupdater();
-	if (lock_fd < 0)
-		return EXIT_FAILURE;
+enum probe_state {
+	PROBE_IDLE,
+	PROBE_RUNNING,
+	PROBE_STOPPED,
+	PROBE_FAILED,
+	PROBE_VALID,
+};
 
-	uloop_init();
+/* A manifest request to a single candidate */
+struct manifest_probe {
+	struct list_head list;
+
+	enum probe_state state;
+	struct candidate candidate;
+	char url[MAX_URL_LENGTH];
+	struct url_request req;
+	struct recv_manifest_ctx manifest_ctx;
+	/* fetch the binary manifest by range requests, see binfetch.c */
+	bool binary;
+	struct binfetch bin;
+	ecc_int256_t hash;
+	double throughput;
+
+	struct http_validators validators;
+	unsigned char validated_hash[HASH_SIZE];
+};
 
-	struct updater_url_ctx direct_download_ctx = {
-		.manifest_url_cb = direct_manifest_url_cb,
+/* Mesh neighbour discovery, running on a thread of its own */
+struct neighbour_discovery {
+	struct mesh_neighbour_ctx ctx;
+	bool running;
+	int err;
+	int pipe[2];
+	struct uloop_fd fd;
+	pthread_t thread;
+	struct trace_span span;
+};
 
-		.image_url_cb = direct_image_url_cb,
-	};
+/*
+ * All candidates in order of preference. Candidates are started one after
+ * another, staggered by STAGGER_MSEC, while mesh neighbours are discovered
+ * in the background and appended as they become known.
+ */
+struct manifest_race {
+	struct settings *s;
+	struct list_head probes;
+	size_t running;
+
+	struct uloop_timeout stagger;
+	bool stagger_elapsed;
+	struct uloop_timeout deadline;
+	bool expired;
 
-	size_t mirrors_left = s.n_mirrors;
-	while (mirrors_left) {
-		const char **mirror = s.mirrors;
-		size_t i = external_mirrors ? 0 : random() % mirrors_left;
+	struct neighbour_discovery discovery;
+};
 
-		/* Move forward by i non-NULL entries */
-		while (true) {
-			while (!*mirror)
-				mirror++;
+static void probe_done_cb(struct url_request *req) {
+	/* Let race_manifests() check the manifest outside of the uclient callback */
+	uloop_end();
+}
 
-			if (!i)
-				break;
+static struct manifest_probe * race_add(struct manifest_race *race) {
+	struct manifest_probe *probe = safe_malloc(sizeof(*probe));
+	memset(probe, 0, sizeof(*probe));
+	list_add_tail(&probe->list, &race->probes);
 
-			mirror++;
-			i--;
-		}
+	return probe;
+}
 
-		struct direct_cb_priv cb_priv = { *mirror };
-		direct_download_ctx.manifest_url_priv = direct_download_ctx.image_url_priv = &cb_priv;
-		if (autoupdate(&s, &direct_download_ctx, lock_fd)) {
-			// update the mtime of the lockfile to indicate a successful run
-			futimens(lock_fd, NULL);
+/** Checks whether a candidate has asked us to come back later */
+static bool backed_off(const char *name) {
+	unsigned long remaining;
+	if (!backoff_active(name, &remaining))
+		return false;
 
-			return EXIT_SUCCESS;
-		}
+	printf("Skipping %s, it asked us to come back in %lu seconds.\n", name, remaining);
+	return true;
+}
 
-		/* When the update has failed, remove the mirror from the list */
-		*mirror = NULL;
-		mirrors_left--;
-	}
+static void race_add_mirror(struct manifest_race *race, const char *mirror) {
+	if (backed_off(mirror))
+		return;
+
+	struct manifest_probe *probe = race_add(race);
+	probe->binary = race->s->binary_manifest;
 
-	puts("autoupdater: No update severs could be reached. Trying to use mesh neighbours as proxy");
+	struct candidate *c = &probe->candidate;
 
-	struct mesh_neighbour_ctx neigh_ctx;
+	c->name = mirror;
+	c->mirror = true;
+	c->priv.direct.mirror = mirror;
+	c->url_ctx = (struct updater_url_ctx){
+		.manifest_url_cb = direct_manifest_url_cb,
+		.manifest_url_priv = &c->priv.direct,
 
-	if(mesh_get_neighbours_respondd(&neigh_ctx, 1001, respondd_mesh_cb, NULL)) {
-		fputs("autoupdater: error: Failed to get mesh neighbours\n", stderr);
-		goto fail_mesh_neigh;
+		.image_url_cb = direct_image_url_cb,
+		.image_url_priv = &c->priv.direct,
+	};
+}
+
+static void race_add_neighbour(struct manifest_race *race, const struct mesh_neighbour *neigh, const struct version_key *current) {
+	const struct neighbour_info *info = neigh->priv;
+	const char *release_str = info->version;
+
+	if(!release_str) {
+		fputs("autoupdater: notice: Skipping neighbour without version info\n", stderr);
+		return;
+	}
+
+	if(current && version_key_compare(&info->version_key, current) <= 0 && !race->s->force) {
+		fprintf(stderr, "autoupdater: notice: Frimware version '%s' not newer than '%s', skipping neighbour\n", release_str, race->s->old_version);
+		return;
 	}
 
-	struct updater_url_ctx proxy_download_ctx = {
+	char addr[INET6_ADDRSTRLEN];
+	inet_ntop(AF_INET6, &neigh->addr, addr, INET6_ADDRSTRLEN);
+	if (backed_off(addr))
+		return;
+
+	struct candidate *c = &race_add(race)->candidate;
+
+	strcpy(c->priv.proxy.proxy_ll_addr, addr);
+	c->name = c->priv.proxy.proxy_ll_addr;
+	c->priv.proxy.proxy_iface = neigh->iface->device;
+	c->url_ctx = (struct updater_url_ctx){
 		.manifest_url_cb = proxy_manifest_url_cb,
+		.manifest_url_priv = &c->priv.proxy,
 
 		.image_url_cb = proxy_image_url_cb,
+		.image_url_priv = &c->priv.proxy,
 	};
+}
+
+static void * discovery_thread(void *arg) {
+	struct neighbour_discovery *discovery = arg;
+
+	discovery->err = mesh_query_neighbours_respondd(&discovery->ctx, RESPONDD_PORT, respondd_mesh_cb, NULL);
+	rank_neighbours(&discovery->ctx.neighbours);
+
+	/* Wake up the uloop */
+	while (write(discovery->pipe[1], "", 1) < 0 && errno == EINTR) {}
+
+	return NULL;
+}
+
+/** Waits for the discovery thread to finish */
+static void discovery_join(struct neighbour_discovery *discovery) {
+	if (!discovery->running)
+		return;
+
+	if (discovery->fd.registered)
+		uloop_fd_delete(&discovery->fd);
+
+	pthread_join(discovery->thread, NULL);
+	close(discovery->pipe[0]);
+	close(discovery->pipe[1]);
+	discovery->running = false;
+}
+
+static void discovery_done_cb(struct uloop_fd *fd, unsigned int events) {
+	struct manifest_race *race = container_of(fd, struct manifest_race, discovery.fd);
+	struct neighbour_discovery *discovery = &race->discovery;
+
+	discovery_join(discovery);
+	trace_span_stop(&discovery->span, TRACE_DISCOVERY);
+
+	if (discovery->err)
+		fputs("autoupdater: warning: Failed to get all mesh neighbours\n", stderr);
+
+	/* The neighbours come newest firmware first */
+	struct version_key current = {};
+	if (race->s->old_version)
+		version_key_init(&current, race->s->old_version);
 
 	struct mesh_neighbour *neigh;
-	list_for_each_entry(neigh, &neigh_ctx.neighbours, list) {
-		char *release_str = neigh->priv;
-		
-		if(!release_str) {
-			fputs("autoupdater: notice: Skipping neighbour without version info\n", stderr);
-			continue;
+	list_for_each_entry(neigh, &discovery->ctx.neighbours, list)
+		race_add_neighbour(race, neigh, race->s->old_version ? &current : NULL);
+
+	version_key_free(&current);
+
+	uloop_end();
+}
+
+/** Starts looking for mesh neighbours which may serve as proxies */
+static void discovery_start(struct manifest_race *race) {
+	struct neighbour_discovery *discovery = &race->discovery;
+
+	trace_span_start(&discovery->span);
+
+	/* The interfaces are looked up via ubus, which must happen on this thread */
+	if (mesh_get_neighbour_interfaces(&discovery->ctx)) {
+		fputs("autoupdater: error: Failed to get mesh interfaces\n", stderr);
+		return;
+	}
+
+	if (pipe2(discovery->pipe, O_CLOEXEC)) {
+		fprintf(stderr, "autoupdater: error: unable to create pipe: %m\n");
+		return;
+	}
+
+	int err = pthread_create(&discovery->thread, NULL, discovery_thread, discovery);
+	if (err) {
+		fprintf(stderr, "autoupdater: error: unable to start neighbour discovery: %s\n", strerror(err));
+		close(discovery->pipe[0]);
+		close(discovery->pipe[1]);
+		return;
+	}
+
+	discovery->fd.fd = discovery->pipe[0];
+	discovery->fd.cb = discovery_done_cb;
+	uloop_fd_add(&discovery->fd, ULOOP_READ);
+	discovery->running = true;
+}
+
+static void stagger_cb(struct uloop_timeout *t) {
+	struct manifest_race *race = container_of(t, struct manifest_race, stagger);
+	race->stagger_elapsed = true;
+	uloop_end();
+}
+
+static void deadline_cb(struct uloop_timeout *t) {
+	struct manifest_race *race = container_of(t, struct manifest_race, deadline);
+	race->expired = true;
+	uloop_end();
+}
+
+static void race_init(struct manifest_race *race, struct settings *s) {
+	memset(race, 0, sizeof(*race));
+	race->s = s;
+	INIT_LIST_HEAD(&race->probes);
+	INIT_LIST_HEAD(&race->discovery.ctx.neighbours);
+	INIT_LIST_HEAD(&race->discovery.ctx.interfaces);
+	race->stagger.cb = stagger_cb;
+	race->deadline.cb = deadline_cb;
+}
+
+/** Starts requesting the manifest from a candidate */
+static bool probe_start(struct manifest_probe *probe, struct settings *s) {
+	const struct updater_url_ctx *url_ctx = &probe->candidate.url_ctx;
+
+	probe->manifest_ctx.s = s;
+
+	if (!URL_CB_OK(url_ctx->manifest_url_cb(probe->url, MAX_URL_LENGTH, s, url_ctx->manifest_url_priv), MAX_URL_LENGTH) ||
+	    (probe->binary && strlen(probe->url) + 4 >= MAX_URL_LENGTH)) {
+		probe->state = PROBE_FAILED;
+		return false;
+	}
+
+	if (probe->binary)
+		strcat(probe->url, ".bin");
+
+	printf("Retrieving manifest from %s ...\n", probe->url);
+
+	hash_init(&probe->manifest_ctx.m.hash_ctx);
+	probe->req.done_cb = probe_done_cb;
+	probe->state = PROBE_RUNNING;
+
+	/* A request failing to start is already done and picked up by race_manifests() */
+	if (probe->binary) {
+		binfetch_start(&probe->bin, &probe->req, probe->url, s->branch, platforminfo_get_image_name());
+		return true;
+	}
+
+	/*
+	 * Only send the validators of this candidate if the manifest they belong
+	 * to is still cached, otherwise a 304 would leave us without a manifest
+	 */
+	if (manifest_cache_get_validators(probe->url, &probe->validators, probe->validated_hash) &&
+	    !manifest_verified_before(probe->validated_hash, s))
+		http_validators_clear(&probe->validators);
+
+	manifest_parser_init(&probe->manifest_ctx.parser, &probe->manifest_ctx.m, s->branch, platforminfo_get_image_name());
+	url_request_start(&probe->req, probe->url, recv_manifest_cb, &probe->manifest_ctx, -1, &probe->validators);
+	return true;
+}
+
+/** Releases the request of a running probe and finalizes the manifest hash */
+static int probe_release(struct manifest_probe *probe, enum probe_state state) {
+	int err_code = url_request_finish(&probe->req);
+	hash_final(&probe->manifest_ctx.m.hash_ctx, probe->hash.p);
+	manifest_parser_free(&probe->manifest_ctx.parser);
+	binfetch_free(&probe->bin);
+
+	probe->throughput = err_code ? 0 : url_request_throughput(&probe->req);
+	probe->state = state;
+
+	return err_code;
+}
+
+/** Checks the manifest of a finished probe, returns true if it is usable */
+static bool probe_check(struct manifest_probe *probe, struct settings *s) {
+	struct manifest *m = &probe->manifest_ctx.m;
+	int err_code = probe_release(probe, PROBE_FAILED);
+
+	if (probe->candidate.mirror)
+		history_record(probe->candidate.name, HISTORY_MANIFEST, &probe->req, err_code == 0);
+
+	bool verified_before;
+	if (err_code == 0 && probe->req.d.not_modified) {
+		/* Restore the manifest from the cache */
+		clear_manifest(m);
+		if (!manifest_cache_load(m, probe->hash.p, s, platforminfo_get_image_name()) ||
+		    memcmp(probe->hash.p, probe->validated_hash, HASH_SIZE)) {
+			fprintf(stderr, "autoupdater: warning: manifest %s not modified, but it is no longer cached\n", probe->url);
+			return false;
 		}
+		printf("Manifest %s not modified since last check.\n", probe->url);
+		verified_before = true;
+	} else if (err_code != 0) {
+		fprintf(stderr, "autoupdater: warning: error downloading manifest %s: %s\n", probe->url, uclient_get_errmsg(err_code));
+		if (uclient_overloaded(err_code))
+			backoff_record(probe->candidate.name, probe->req.d.retry_after);
+		return false;
+	} else {
+		/* Check manifest signatures, unless the very same manifest has been verified before */
+		verified_before = manifest_verified_before(probe->hash.p, s);
+		if (verified_before)
+			printf("Manifest %s unchanged since last check, skipping signature verification.\n", probe->url);
+	}
 
-		if(!newer_than(release_str, s.old_version) && !s.force) {
-			fprintf(stderr, "autoupdater: notice: Frimware version '%s' not newer than '%s', skipping neighbour\n", release_str, s.old_version);
+	if (!verified_before) {
+		struct trace_span verify_span;
+		status_set_state(STATUS_VERIFYING);
+		trace_span_start(&verify_span);
+		long unsigned int good_signatures = verify_signatures(&probe->hash, m->signatures, m->n_signatures, s->pubkeys, s->n_pubkeys, s->good_signatures);
+		trace_span_stop(&verify_span, TRACE_VERIFY);
+		/* Other manifests may still be coming in */
+		status_set_state(STATUS_MANIFEST);
+		if (good_signatures < s->good_signatures) {
+			fprintf(stderr, "autoupdater: warning: manifest %s only carried %lu valid signatures, %lu are required\n", probe->url, good_signatures, s->good_signatures);
+			return false;
+		}
+	}
+
+	/* Check manifest */
+	if (!m->date_ok || !m->priority_ok) {
+		fprintf(stderr, "autoupdater: warning: manifest %s is missing mandatory fields\n", probe->url);
+		return false;
+	}
+
+	if (!m->branch_ok) {
+		fprintf(stderr, "autoupdater: warning: manifest %s is not for branch %s\n", probe->url, s->branch);
+		return false;
+	}
+
+	if (!m->model_ok) {
+		fprintf(stderr, "autoupdater: warning: no matching firmware found (model %s)\n", platforminfo_get_image_name());
+		return false;
+	}
+
+	if (!verified_before)
+		manifest_cache_store(m, probe->hash.p, s, platforminfo_get_image_name());
+
+	/* Remember the validators of a fresh response; a 304 leaves them unchanged */
+	if (!probe->req.d.not_modified && !probe->binary)
+		manifest_cache_set_validators(probe->url, &probe->validators, probe->hash.p);
+
+	backoff_clear(probe->candidate.name);
+
+	probe->state = PROBE_VALID;
+	return true;
+}
+
+/** Starts the next candidate that hasn't been tried yet, returns false if there is none */
+static bool race_start_next(struct manifest_race *race) {
+	if (race->running >= MANIFEST_PROBES)
+		return false;
+
+	struct manifest_probe *probe;
+	list_for_each_entry(probe, &race->probes, list) {
+		if (probe->state != PROBE_IDLE)
 			continue;
+
+		if (probe_start(probe, race->s)) {
+			race->running++;
+			return true;
 		}
+	}
+
+	return false;
+}
 
-		char v6_addr_tmp[INET6_ADDRSTRLEN];
+/**
+ * Requests the manifest from the candidates of a race, happy-eyeballs
+ * style: the next candidate is started as soon as the previous one has
+ * failed or after STAGGER_MSEC, whichever comes first. Returns the first
+ * probe delivering a valid manifest, or NULL if no candidate succeeded
+ * within RACE_DEADLINE_MSEC.
+ */
+static struct manifest_probe * race_manifests(struct manifest_race *race) {
+	race->stagger_elapsed = true;
+	uloop_timeout_set(&race->deadline, RACE_DEADLINE_MSEC);
 
-		struct proxy_cb_priv proxy_priv = {
-			.proxy_ll_addr = inet_ntop(AF_INET6, &neigh->addr, v6_addr_tmp, INET6_ADDRSTRLEN),
-			.proxy_iface = neigh->iface->device,
-		};
+	while (true) {
+		/* Set if a request was started which may have failed right away */
+		bool recheck = false;
+
+		struct manifest_probe *probe;
+		list_for_each_entry(probe, &race->probes, list) {
+			if (probe->state != PROBE_RUNNING || !probe->req.d.done)
+				continue;
+
+			if (probe->binary) {
+				enum binfetch_status status = binfetch_continue(&probe->bin, &probe->req, &probe->manifest_ctx.m);
 
-		proxy_download_ctx.manifest_url_priv = proxy_download_ctx.image_url_priv = &proxy_priv;
+				if (status == BINFETCH_PENDING) {
+					recheck = true;
+					continue;
+				}
 
-		if (autoupdate(&s, &proxy_download_ctx, lock_fd)) {
-			// update the mtime of the lockfile to indicate a successful run
-			futimens(lock_fd, NULL);
-			list_for_each_entry(neigh, &neigh_ctx.neighbours, list) {
-				if(neigh->priv) {
-					free(neigh->priv);
+				if (status == BINFETCH_UNAVAILABLE) {
+					printf("No binary manifest on %s, falling back to the text manifest.\n", probe->candidate.name);
+					hash_final(&probe->manifest_ctx.m.hash_ctx, probe->hash.p);
+					binfetch_free(&probe->bin);
+					probe->binary = false;
+					if (probe_start(probe, race->s)) {
+						recheck = true;
+						continue;
+					}
 				}
+
+				if (status == BINFETCH_INVALID)
+					probe_release(probe, PROBE_FAILED);
+			}
+
+			race->running--;
+
+			if (probe->state == PROBE_FAILED) {
+				race->stagger_elapsed = true;
+				continue;
 			}
 
-			mesh_free_respondd_neighbours_ctx(&neigh_ctx);
-			return EXIT_SUCCESS;
+			if (probe_check(probe, race->s))
+				return probe;
+
+			/* Don't wait for the stagger delay to try the next candidate */
+			race->stagger_elapsed = true;
 		}
+
+		if (race->expired) {
+			fputs("autoupdater: warning: no valid manifest received in time\n", stderr);
+			return NULL;
+		}
+
+		if (race->stagger_elapsed && race_start_next(race)) {
+			race->stagger_elapsed = false;
+			uloop_timeout_set(&race->stagger, STAGGER_MSEC);
+
+			/* The request may have failed right away */
+			continue;
+		}
+
+		if (!race->running && !race->discovery.running)
+			return NULL;
+
+		if (!recheck)
+			uloop_run();
+	}
+}
+
+/** Stops everything still going on in the background of a race */
+static void race_stop(struct manifest_race *race) {
+	uloop_timeout_cancel(&race->stagger);
+	uloop_timeout_cancel(&race->deadline);
+
+	struct manifest_probe *probe;
+	list_for_each_entry(probe, &race->probes, list) {
+		if (probe->state == PROBE_RUNNING)
+			probe_release(probe, PROBE_STOPPED);
+	}
+	race->running = 0;
+
+	/* Neighbours found from now on are of no interest, the thread is joined by race_free() */
+	if (race->discovery.fd.registered)
+		uloop_fd_delete(&race->discovery.fd);
+}
+
+static void race_free(struct manifest_race *race) {
+	race_stop(race);
+	discovery_join(&race->discovery);
+
+	struct manifest_probe *probe, *next;
+	list_for_each_entry_safe(probe, next, &race->probes, list) {
+		list_del(&probe->list);
+		http_validators_clear(&probe->validators);
+		clear_manifest(&probe->manifest_ctx.m);
+		free(probe);
 	}
 
-fail_mesh_neigh:
-	list_for_each_entry(neigh, &neigh_ctx.neighbours, list) {
-		if(neigh->priv) {
-			free(neigh->priv);
+	struct mesh_neighbour *neigh;
+	list_for_each_entry(neigh, &race->discovery.ctx.neighbours, list)
+		neighbour_info_free(neigh->priv);
+
+	mesh_free_respondd_neighbours_ctx(&race->discovery.ctx);
+}
+
+/**
+ * Orders the candidates to download the image from: the candidate whose
+ * manifest won comes first, followed by the other candidates which delivered
+ * a manifest, fastest first, and then those we know nothing about. Candidates
+ * which failed are left out. Returns the number of entries in order.
+ */
+static size_t order_image_sources(struct manifest_probe **order, const struct manifest_race *race, struct manifest_probe *winner) {
+	size_t n = 0;
+
+	order[n++] = winner;
+
+	struct manifest_probe *probe;
+	list_for_each_entry(probe, &race->probes, list) {
+		if (probe == winner || probe->state == PROBE_FAILED)
+			continue;
+
+		/* Insertion sort, keeping the order of candidates with equal throughput */
+		size_t j = n++;
+		while (j > 1 && order[j-1]->throughput < probe->throughput) {
+			order[j] = order[j-1];
+			j--;
 		}
+		order[j] = probe;
+	}
+
+	return n;
+}
+
+/** Downloads the image from one candidate into fd and checks its checksum */
+static bool download_image(const struct settings *s, const struct manifest *m, const struct candidate *c, int fd) {
+	const struct updater_url_ctx *url_ctx = &c->url_ctx;
+	char image_url[MAX_URL_LENGTH];
+	if(!URL_CB_OK(url_ctx->image_url_cb(image_url, MAX_URL_LENGTH, s, m->image_filename, url_ctx->image_url_priv), MAX_URL_LENGTH)) {
+		return false;
+	}
+
+	printf("Downloading image from '%s'\n", image_url);
+
+	if (ftruncate(fd, 0) || lseek(fd, 0, SEEK_SET)) {
+		fprintf(stderr, "autoupdater: error: unable to truncate firmware file: %m\n");
+		return false;
+	}
+
+	/* Download image and calculate SHA256 checksum */
+	struct recv_image_ctx image_ctx = { .fd = fd };
+	unsigned char image_hash[HASH_SIZE];
+
+	hash_init(&image_ctx.hash_ctx);
+	pipeline_init(&image_ctx.pipeline, image_sink, &image_ctx);
+	status_set_state(STATUS_DOWNLOADING);
+	status_set_source(c->name, c->mirror);
+	struct trace_span span;
+	trace_span_start(&span);
+	struct url_request req = { };
+	int err_code = url_request_run(&req, image_url, &recv_image_cb, &image_ctx, m->imagesize, NULL);
+	int write_err = pipeline_finish(&image_ctx.pipeline);
+	trace_span_stop(&span, TRACE_IMAGE);
+	trace_request(TRACE_REQUEST_IMAGE, c->name, &req);
+	status_progress_done();
+
+	status_set_state(STATUS_VERIFYING);
+	trace_span_start(&span);
+	hash_final(&image_ctx.hash_ctx, image_hash);
+	bool hash_ok = !memcmp(image_hash, m->image_hash, HASH_SIZE);
+	trace_span_stop(&span, TRACE_HASH);
+
+	if (c->mirror)
+		history_record(c->name, HISTORY_IMAGE, &req, err_code == 0);
+	if (err_code != 0) {
+		fprintf(stderr, "autoupdater: warning: error downloading image: %s\n", uclient_get_errmsg(err_code));
+		if (uclient_overloaded(err_code))
+			backoff_record(c->name, req.d.retry_after);
+		return false;
+	}
+	if (write_err) {
+		fprintf(stderr, "autoupdater: error: downloading firmware image failed: %s\n", strerror(write_err));
+		return false;
+	}
+
+	/* Verify image checksum */
+	if (!hash_ok) {
+		fputs("autoupdater: warning: invalid image checksum!\n", stderr);
+		return false;
+	}
+
+	return true;
+}
+
+static bool autoupdate(struct settings *s, struct manifest_race *race, int lock_fd) {
+	bool ret = false;
+	struct manifest_probe **order = NULL;
+
+	/**** Get and check manifest *****************************************/
+	struct trace_span manifest_span;
+	trace_span_start(&manifest_span);
+	struct manifest_probe *winner = race_manifests(race);
+	trace_span_stop(&manifest_span, TRACE_MANIFEST);
+	if (!winner) {
+		trace_result("no_manifest");
+		goto out;
+	}
+
+	struct manifest *m = &winner->manifest_ctx.m;
+	trace_request(TRACE_REQUEST_MANIFEST, winner->candidate.name, &winner->req);
+
+	/* The remaining candidates have lost the race */
+	race_stop(race);
+
+	/* Check version and update probability */
+	if (!newer_than(m->version, s->old_version) && !s->force_version) {
+		puts("No new firmware available.");
+		trace_result("current");
+		ret = true;
+		goto out;
 	}
 
-	mesh_free_respondd_neighbours_ctx(&neigh_ctx);
+	if (!s->force && !rollout_due(s, m)) {
+		fputs("autoupdater: info: no autoupdate this time. Use -f to override.\n", stderr);
+		trace_result("not_due");
+		ret = true;
+		goto out;
+	}
 
+	/**** Download and verify image file *********************************/
+	/* Begin download of the image */
+	run_dir(download_d_dir);
+
+	/* Decide where the image goes only after download.d had the chance to free memory */
+	struct download_plan plan;
+	if (!plan_download(&plan, &default_storage_env, m->imagesize, s->storage, s->n_storage)) {
+		fprintf(stderr, "autoupdater: error: not enough memory or storage for an image of %zi KiB\n", m->imagesize / 1024);
+		trace_result("no_space");
+		goto fail_after_download;
+	}
+	const char *firmware_path = plan.path;
+
+	int fd = open(firmware_path, O_WRONLY|O_CREAT, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "autoupdater: error: failed opening firmware file %s\n", firmware_path);
+		trace_result("download_failed");
+		goto fail_after_download;
+	}
+
+	/* Fall back to the other candidates if the image can't be downloaded from the winner */
+	size_t n_candidates = 0;
+	struct manifest_probe *probe;
+	list_for_each_entry(probe, &race->probes, list)
+		n_candidates++;
+
+	order = safe_malloc(n_candidates * sizeof(*order));
+	size_t n_sources = order_image_sources(order, race, winner);
+	bool downloaded = false;
+	for (size_t i = 0; i < n_sources && !downloaded; i++) {
+		downloaded = download_image(s, m, &order[i]->candidate, fd);
+		if (downloaded)
+			backoff_clear(order[i]->candidate.name);
+	}
+
+	close(fd);
+	if (!downloaded) {
+		trace_result("download_failed");
+		goto fail_after_download;
+	}
+
+	/**** Call sysupgrade ************************************************/
+	if (s->no_action) {
+		printf(
+			"autoupdater: info: Aborting successful upgrade because simulation was requested.\n"
+			"autoupdater: info: You can find the firmware file in %s\n",
+			firmware_path
+		);
+		run_dir(abort_d_dir);
+		trace_result("simulated");
+		ret = true;
+		goto out;
+	}
+
+	/* Begin upgrade */
+	status_set_state(STATUS_UPGRADING);
+	run_dir(upgrade_d_dir);
+
+	/* sysupgrade replaces this process */
+	trace_result("upgrading");
+	trace_write();
+
+	/* Unset FD_CLOEXEC so the lockfile stays locked during sysupgrade */
+	fcntl(lock_fd, F_SETFD, 0);
+
+	execl(sysupgrade_path, sysupgrade_path, firmware_path, NULL);
+
+	/* execl() shouldn't return */
+	fputs("autoupdater: error: failed to call sysupgrade\n", stderr);
+
+	fcntl(lock_fd, F_SETFD, FD_CLOEXEC);
+
+fail_after_download:
+	if (plan.target != DOWNLOAD_TARGET_NONE)
+		unlink(plan.path);
+	run_dir(abort_d_dir);
+
+out:
+	free(order);
+	return ret;
+}
+
+
+static bool external_mirrors;
+
+/** Runs a single check for updates, doesn't return if an update is installed */
+static bool check_update(struct settings *s, int lock_fd) {
+	trace_begin();
+	status_set_state(STATUS_MANIFEST);
+
+	/* Mirrors given on the command line are tried in the given order */
+	if (!external_mirrors)
+		history_rank(s->mirrors, s->n_mirrors);
+
+	/*
+	 * The mirrors are preferred, mesh neighbours serving as proxies are
+	 * tried after them as soon as they have been discovered
+	 */
+	struct manifest_race race;
+	race_init(&race, s);
+
+	for (size_t i = 0; i < s->n_mirrors; i++)
+		race_add_mirror(&race, s->mirrors[i]);
+
+	discovery_start(&race);
+
+	bool updated = autoupdate(s, &race, lock_fd);
+	race_free(&race);
+	url_pool_flush();
+	status_finish(updated, trace_get_result());
+	trace_write();
+
+	if (updated) {
+		// update the mtime of the lockfile to indicate a successful run
+		futimens(lock_fd, NULL);
+	} else {
+		fputs("autoupdater: error: no usable mirror found\n", stderr);
+	}
+
+	return updated;
+}
+
+/** A check of the daemon, taking the lock only while it runs */
+static void daemon_check(struct settings *s) {
+	int lock_fd = lock_autoupdater();
+	if (lock_fd < 0)
+		return;
+
+	check_update(s, lock_fd);
+	close(lock_fd);
+}
+
+int main(int argc, char *argv[]) {
+	struct settings s = { };
+	parse_args(argc, argv, &s);
+
+	if (!platforminfo_get_image_name()) {
+		fputs("autoupdater: error: unsupported hardware model\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	external_mirrors = s.n_mirrors > 0;
+
+	struct trace_span config_span;
+	trace_span_start(&config_span);
+	load_settings(&s);
+	hash_select(s.hash_backend);
+	trace_span_stop(&config_span, TRACE_CONFIG);
+	trace_set_budget(s.rss_budget, s.cpu_budget);
+	randomize();
+
+	if (s.daemon) {
+		uloop_init();
+		int ret = run_daemon(&s, daemon_check);
+		uloop_done();
+		return ret;
+	}
+
+	int lock_fd = lock_autoupdater();
+	if (lock_fd < 0)
+		return EXIT_FAILURE;
+
+	uloop_init();
+	status_publish();
+	bool updated = check_update(&s, lock_fd);
+	status_unpublish();
 	uloop_done();
 
-	fputs("autoupdater: error: no usable mirror found\n", stderr);
-	return EXIT_FAILURE;
+	return updated ? EXIT_SUCCESS : EXIT_FAILURE;
 }
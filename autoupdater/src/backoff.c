@@ -0,0 +1,111 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "backoff.h"
+#include "statefile.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/*
+ * Sources which turned us down as overloaded (HTTP 429 or 503) are left
+ * alone for a while. The pause doubles with every refusal in a row, but
+ * is never shorter than what the source asked for in Retry-After. Entries
+ * are keyed by the name of the source:
+ * <not before, seconds of monotonic time> TAB <refusals in a row>
+ */
+static const char *const backoff_path = "/tmp/autoupdater.backoff";
+
+#define BACKOFF_BASE 600
+#define BACKOFF_MAX 86400
+
+
+static bool backoff_load(const char *name, double *not_before, unsigned long *failures) {
+	char *value = statefile_get(backoff_path, name);
+	if (!value)
+		return false;
+
+	bool ret = sscanf(value, "%lf\t%lu", not_before, failures) == 2;
+	free(value);
+
+	return ret;
+}
+
+
+/** Checks whether a source asked to be left alone, and for how many more seconds */
+bool backoff_active(const char *name, unsigned long *remaining) {
+	double not_before;
+	unsigned long failures;
+
+	if (!backoff_load(name, &not_before, &failures))
+		return false;
+
+	double now = get_time();
+	if (now >= not_before)
+		return false;
+
+	*remaining = not_before - now;
+	return true;
+}
+
+
+/** Records a refusal of a source */
+void backoff_record(const char *name, unsigned long retry_after) {
+	double not_before;
+	unsigned long failures = 0;
+
+	backoff_load(name, &not_before, &failures);
+	failures++;
+
+	unsigned long delay = BACKOFF_MAX;
+	if (failures <= 8 && (BACKOFF_BASE << (failures - 1)) < BACKOFF_MAX)
+		delay = BACKOFF_BASE << (failures - 1);
+
+	if (retry_after > delay)
+		delay = retry_after < BACKOFF_MAX ? retry_after : BACKOFF_MAX;
+
+	fprintf(stderr, "autoupdater: info: %s is overloaded, leaving it alone for %lu seconds\n", name, delay);
+
+	char value[64];
+	snprintf(value, sizeof(value), "%.0f\t%lu", get_time() + delay, failures);
+	if (!statefile_set(backoff_path, name, value))
+		fprintf(stderr, "autoupdater: warning: unable to store backoff state: %m\n");
+}
+
+
+/** Forgets the refusals of a source after it has served us */
+void backoff_clear(const char *name) {
+	double not_before;
+	unsigned long failures;
+
+	if (!backoff_load(name, &not_before, &failures))
+		return;
+
+	if (!statefile_set(backoff_path, name, NULL))
+		fprintf(stderr, "autoupdater: warning: unable to store backoff state: %m\n");
+}
@@ -0,0 +1,320 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "binfetch.h"
+#include "binmanifest.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+ * A binary manifest is fetched in up to three range requests: the first
+ * HEAD_FETCH bytes, which usually hold the signatures and the header, the
+ * index bucket our model is listed in, and our entry with its Merkle proof.
+ * Servers ignoring the Range header send the whole manifest instead, which
+ * is used as long as it doesn't exceed MAX_FETCH.
+ */
+#define HEAD_FETCH 4096
+#define MAX_FETCH (1024 * 1024)
+
+#define NO_BASE SIZE_MAX
+
+
+static void recv_range_cb(struct uclient *cl) {
+	struct binfetch *f = uclient_get_custom(cl);
+	char discard[256];
+	int len;
+
+	/* A server ignoring the range starts at the beginning of the manifest */
+	if (f->base == NO_BASE)
+		f->base = cl->status_code == 206 ? f->want_off : 0;
+
+	while (true) {
+		if (f->len == f->size && f->size < MAX_FETCH) {
+			f->size = f->size ? 2 * f->size : HEAD_FETCH;
+			if (f->size > MAX_FETCH)
+				f->size = MAX_FETCH;
+			f->buf = safe_realloc(f->buf, f->size);
+		}
+
+		if (f->len < f->size)
+			len = uclient_read_account(cl, (char *)f->buf + f->len, f->size - f->len);
+		else
+			len = uclient_read_account(cl, discard, sizeof(discard));
+		if (len <= 0)
+			break;
+
+		if (f->len < f->size)
+			f->len += len;
+		else
+			f->overflow = true;
+	}
+}
+
+
+static bool have(const struct binfetch *f, size_t off, size_t len) {
+	return f->base != NO_BASE && off >= f->base && off - f->base + len <= f->len;
+}
+
+static const unsigned char * at(const struct binfetch *f, size_t off) {
+	return f->buf + (off - f->base);
+}
+
+
+/** Requests the part of the manifest the current stage needs */
+static void fetch(struct binfetch *f, struct url_request *req) {
+	snprintf(f->range, sizeof(f->range), "bytes=%zu-%zu", f->want_off, f->want_off + f->want_len - 1);
+
+	f->len = 0;
+	f->overflow = false;
+	/* Set once the response arrives, see recv_range_cb() */
+	f->base = NO_BASE;
+	req->range = f->range;
+
+	url_request_start(req, f->url, recv_range_cb, f, -1, NULL);
+}
+
+
+static enum binfetch_status invalid(const struct binfetch *f, const char *what) {
+	fprintf(stderr, "autoupdater: warning: binary manifest %s: %s\n", f->url, what);
+	return BINFETCH_INVALID;
+}
+
+
+/** Takes the signatures and fields from the header and finds the bucket of our model */
+static enum binfetch_status parse_header(struct binfetch *f, struct manifest *m) {
+	if (!have(f, 0, BINMANIFEST_PREAMBLE_SIZE) || memcmp(at(f, 0), BINMANIFEST_MAGIC, 4))
+		return invalid(f, "bad magic");
+
+	size_t n_signatures = binmanifest_get16(at(f, 4));
+	size_t header_off = BINMANIFEST_PREAMBLE_SIZE + n_signatures * BINMANIFEST_SIGNATURE_SIZE;
+
+	size_t need = header_off + BINMANIFEST_HEADER_FIXED_SIZE;
+	if (have(f, 0, need))
+		need = header_off + binmanifest_get32(at(f, header_off));
+
+	if (!have(f, 0, need)) {
+		/* Once for the fixed part of the header, once for the rest */
+		if (++f->header_tries > 2)
+			return invalid(f, "truncated header");
+
+		f->want_off = 0;
+		f->want_len = need;
+		return BINFETCH_PENDING;
+	}
+
+	const unsigned char *h = at(f, header_off);
+	size_t header_len = binmanifest_get32(h);
+	uint32_t n_buckets = binmanifest_get32(h + 8);
+	size_t fields_len = binmanifest_get16(h + 44);
+
+	f->n_entries = binmanifest_get32(h + 4);
+	memcpy(f->root, h + 12, sizeof(f->root));
+
+	if (!n_buckets || !f->n_entries || n_buckets > MAX_FETCH ||
+	    header_len != BINMANIFEST_HEADER_FIXED_SIZE + fields_len + (size_t)n_buckets * BINMANIFEST_BUCKET_SIZE)
+		return invalid(f, "bad header");
+
+	/* The signatures cover the magic and the header, which includes the Merkle root of all entries */
+	hash_update(&m->hash_ctx, BINMANIFEST_MAGIC, 4);
+	hash_update(&m->hash_ctx, h, header_len);
+
+	if (n_signatures > MANIFEST_MAX_SIGNATURES) {
+		fprintf(stderr, "autoupdater: warning: binary manifest %s: ignoring signatures beyond the first %u\n", f->url, MANIFEST_MAX_SIGNATURES);
+		n_signatures = MANIFEST_MAX_SIGNATURES;
+	}
+
+	for (size_t i = 0; i < n_signatures; i++) {
+		ecdsa_signature_t *sig = safe_malloc(sizeof(*sig));
+		memcpy(sig, at(f, BINMANIFEST_PREAMBLE_SIZE + i * BINMANIFEST_SIGNATURE_SIZE), sizeof(*sig));
+
+		m->n_signatures++;
+		m->signatures = safe_realloc(m->signatures, m->n_signatures * sizeof(ecdsa_signature_t *));
+		m->signatures[m->n_signatures - 1] = sig;
+	}
+
+	char *fields = strndup((const char *)h + BINMANIFEST_HEADER_FIXED_SIZE, fields_len);
+	char *saveptr;
+	for (char *line = strtok_r(fields, "\n", &saveptr); line; line = strtok_r(NULL, "\n", &saveptr))
+		parse_line(line, m, f->branch, f->image_name);
+	free(fields);
+
+	f->body_off = header_off + header_len;
+
+	const unsigned char *bucket = h + BINMANIFEST_HEADER_FIXED_SIZE + fields_len +
+		binmanifest_bucket(f->image_name, strlen(f->image_name), n_buckets) * BINMANIFEST_BUCKET_SIZE;
+	f->want_off = f->body_off + binmanifest_get32(bucket);
+	f->want_len = binmanifest_get32(bucket + 4);
+
+	/* An empty bucket: our model isn't listed */
+	if (!f->want_len)
+		return BINFETCH_FINISHED;
+
+	f->stage = BINFETCH_INDEX;
+	return BINFETCH_PENDING;
+}
+
+
+/** Looks up the entry of our model in its index bucket */
+static enum binfetch_status parse_index(struct binfetch *f) {
+	const unsigned char *p = at(f, f->want_off), *end = p + f->want_len;
+	size_t image_name_len = strlen(f->image_name);
+
+	while (p < end) {
+		if (end - p < 2 || (size_t)(end - p) < 2u + binmanifest_get16(p) + 8)
+			return invalid(f, "bad index");
+
+		size_t name_len = binmanifest_get16(p);
+		const unsigned char *name = p + 2;
+		p += 2 + name_len;
+
+		if (name_len == image_name_len && !memcmp(name, f->image_name, name_len)) {
+			f->want_off = f->body_off + binmanifest_get32(p);
+			f->want_len = binmanifest_get32(p + 4);
+			f->stage = BINFETCH_ENTRY;
+			return BINFETCH_PENDING;
+		}
+
+		p += 8;
+	}
+
+	/* Our model isn't listed */
+	return BINFETCH_FINISHED;
+}
+
+
+/** Checks the Merkle proof of our entry and parses its model line */
+static enum binfetch_status parse_entry(struct binfetch *f, struct manifest *m) {
+	const unsigned char *p = at(f, f->want_off);
+	size_t len = f->want_len;
+
+	if (len < 5)
+		return invalid(f, "bad entry");
+
+	uint32_t leaf_index = binmanifest_get32(p);
+	size_t depth = p[4];
+	size_t line_off = 5 + depth * BINMANIFEST_HASH_SIZE;
+
+	if (depth > BINMANIFEST_MAX_DEPTH || len < line_off + 2 || len != line_off + 2 + binmanifest_get16(p + line_off))
+		return invalid(f, "bad entry");
+
+	size_t line_len = binmanifest_get16(p + line_off);
+	char *line = strndup((const char *)p + line_off + 2, line_len);
+
+	if (strlen(line) != line_len ||
+	    !binmanifest_verify_proof(f->root, f->n_entries, leaf_index, p + 5, depth, line, line_len)) {
+		free(line);
+		return invalid(f, "entry doesn't match the signed Merkle root");
+	}
+
+	parse_line(line, m, f->branch, f->image_name);
+	free(line);
+
+	if (!m->model_ok)
+		return invalid(f, "entry belongs to another model");
+
+	return BINFETCH_FINISHED;
+}
+
+
+/** Works through the data at hand, returns BINFETCH_PENDING if another request has been started */
+static enum binfetch_status advance(struct binfetch *f, struct url_request *req, struct manifest *m) {
+	while (true) {
+		enum binfetch_status status;
+
+		if (f->stage == BINFETCH_HEADER)
+			status = parse_header(f, m);
+		else if (!have(f, f->want_off, f->want_len))
+			return invalid(f, "short response");
+		else if (f->stage == BINFETCH_INDEX)
+			status = parse_index(f);
+		else
+			return parse_entry(f, m);
+
+		if (status != BINFETCH_PENDING)
+			return status;
+
+		if (!f->want_len || f->want_len > MAX_FETCH)
+			return invalid(f, "bad offsets");
+
+		/* The whole manifest may have been received already */
+		if (!have(f, f->want_off, f->want_len)) {
+			fetch(f, req);
+			return BINFETCH_PENDING;
+		}
+	}
+}
+
+
+/**
+ * Starts fetching a binary manifest. req->done_cb and req->priv must be set,
+ * and binfetch_continue() be called whenever the request is done.
+ */
+void binfetch_start(struct binfetch *f, struct url_request *req, const char *url, const char *branch, const char *image_name) {
+	*f = (struct binfetch){
+		.url = url,
+		.branch = branch,
+		.image_name = image_name,
+		.stage = BINFETCH_HEADER,
+		.want_len = HEAD_FETCH,
+	};
+
+	fetch(f, req);
+}
+
+
+/**
+ * Processes the response to the last request and starts the next one if
+ * needed. The signed header is added to the hash of the manifest, the
+ * signatures and fields are stored in it like those of a text manifest.
+ */
+enum binfetch_status binfetch_continue(struct binfetch *f, struct url_request *req, struct manifest *m) {
+	int err_code = url_request_finish(req);
+	req->range = NULL;
+
+	if (err_code) {
+		if (f->stage == BINFETCH_HEADER && !f->header_tries && uclient_not_found(err_code))
+			return BINFETCH_UNAVAILABLE;
+
+		/* The error is still recorded in the request */
+		return BINFETCH_FINISHED;
+	}
+
+	if (f->overflow)
+		return invalid(f, "too large");
+
+	return advance(f, req, m);
+}
+
+
+void binfetch_free(struct binfetch *f) {
+	free(f->buf);
+	f->buf = NULL;
+	f->len = f->size = 0;
+}
@@ -0,0 +1,81 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+
+#include "manifest.h"
+#include "uclient.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+enum binfetch_status {
+	/* another range request has been started */
+	BINFETCH_PENDING,
+	/* done, the manifest is complete unless the request failed */
+	BINFETCH_FINISHED,
+	/* the server sent something which isn't a valid binary manifest */
+	BINFETCH_INVALID,
+	/* the server has no binary manifest */
+	BINFETCH_UNAVAILABLE,
+};
+
+enum binfetch_stage {
+	BINFETCH_HEADER,
+	BINFETCH_INDEX,
+	BINFETCH_ENTRY,
+};
+
+/* Fetches the parts of a binary manifest concerning one model, see binfetch.c */
+struct binfetch {
+	const char *url;
+	const char *branch;
+	const char *image_name;
+
+	enum binfetch_stage stage;
+	unsigned header_tries;
+	/* the part of the manifest the current stage needs */
+	size_t want_off;
+	size_t want_len;
+	char range[64];
+
+	/* data received by the last request and its offset in the manifest */
+	unsigned char *buf;
+	size_t len;
+	size_t size;
+	size_t base;
+	bool overflow;
+
+	size_t body_off;
+	uint32_t n_entries;
+	unsigned char root[32];
+};
+
+
+void binfetch_start(struct binfetch *f, struct url_request *req, const char *url, const char *branch, const char *image_name);
+enum binfetch_status binfetch_continue(struct binfetch *f, struct url_request *req, struct manifest *m);
+void binfetch_free(struct binfetch *f);
@@ -0,0 +1,107 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "binmanifest.h"
+
+#include <ecdsautil/sha256.h>
+
+#include <string.h>
+
+
+/*
+ * Only the format itself lives here, it is shared with the manifest
+ * compiler in tools/, which runs on the build host. Hashing therefore
+ * uses ecdsautil directly instead of the hash backends of the node; a
+ * proof takes a handful of hashes only.
+ */
+
+
+/** Returns the bucket of the index a model is listed in */
+uint32_t binmanifest_bucket(const char *model, size_t len, uint32_t n_buckets) {
+	uint32_t hash = 2166136261u;
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char)model[i];
+		hash *= 16777619u;
+	}
+
+	return hash % n_buckets;
+}
+
+
+void binmanifest_leaf_hash(unsigned char out[BINMANIFEST_HASH_SIZE], const char *line, size_t len) {
+	ecdsa_sha256_context_t ctx;
+	const unsigned char prefix = 0x00;
+
+	ecdsa_sha256_init(&ctx);
+	ecdsa_sha256_update(&ctx, &prefix, 1);
+	ecdsa_sha256_update(&ctx, line, len);
+	ecdsa_sha256_final(&ctx, out);
+}
+
+
+void binmanifest_node_hash(unsigned char out[BINMANIFEST_HASH_SIZE], const unsigned char left[BINMANIFEST_HASH_SIZE], const unsigned char right[BINMANIFEST_HASH_SIZE]) {
+	ecdsa_sha256_context_t ctx;
+	const unsigned char prefix = 0x01;
+
+	ecdsa_sha256_init(&ctx);
+	ecdsa_sha256_update(&ctx, &prefix, 1);
+	ecdsa_sha256_update(&ctx, left, BINMANIFEST_HASH_SIZE);
+	ecdsa_sha256_update(&ctx, right, BINMANIFEST_HASH_SIZE);
+	ecdsa_sha256_final(&ctx, out);
+}
+
+
+/** Checks that line is the entry leaf_index of the tree with the given root */
+bool binmanifest_verify_proof(const unsigned char root[BINMANIFEST_HASH_SIZE], uint32_t n_entries, uint32_t leaf_index,
+			      const unsigned char *proof, size_t depth, const char *line, size_t len) {
+	if (leaf_index >= n_entries)
+		return false;
+
+	unsigned char hash[BINMANIFEST_HASH_SIZE];
+	binmanifest_leaf_hash(hash, line, len);
+
+	uint32_t index = leaf_index;
+	size_t used = 0;
+
+	for (uint32_t n = n_entries; n > 1; n = n / 2 + n % 2) {
+		/* The last node of a level with an odd count has no sibling */
+		if ((index ^ 1) < n) {
+			if (used == depth)
+				return false;
+
+			const unsigned char *sibling = proof + used++ * BINMANIFEST_HASH_SIZE;
+			if (index & 1)
+				binmanifest_node_hash(hash, sibling, hash);
+			else
+				binmanifest_node_hash(hash, hash, sibling);
+		}
+
+		index /= 2;
+	}
+
+	return used == depth && !memcmp(hash, root, BINMANIFEST_HASH_SIZE);
+}
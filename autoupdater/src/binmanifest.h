@@ -0,0 +1,102 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * The binary manifest holds the same information as the text manifest, laid
+ * out so a node can fetch just the parts it needs with HTTP range requests.
+ * All integers are big-endian.
+ *
+ * Preamble:
+ *   magic "GMB2", u16 number of signatures, u16 reserved
+ *   the signatures, 64 bytes each
+ * Header:
+ *   u32 length of the header, u32 number of entries, u32 number of buckets
+ *   Merkle root of the entries (32 bytes)
+ *   u16 length of the fields, the fields: the BRANCH=, DATE= and PRIORITY=
+ *   lines of the text manifest, each terminated by a newline
+ *   per bucket: u32 offset and u32 length of its index records
+ * Body, offsets are relative to its start:
+ *   index records, grouped by bucket:
+ *     u16 length of the model name, the model name,
+ *     u32 offset and u32 length of its entry
+ *   entries, sorted by model name:
+ *     u32 leaf index, u8 depth of the proof, the proof (32 bytes per level),
+ *     u16 length of the line, the model line of the text manifest
+ *
+ * The signatures are made over the magic followed by the header. The magic
+ * carries the version of the format, so a signature can't be taken for one
+ * of a text manifest or another version of this format.
+ *
+ * The leaves of the Merkle tree are SHA256(0x00 || line), the inner nodes
+ * SHA256(0x01 || left || right). A node without a sibling is carried up to
+ * the next level unchanged, so the proof only holds the siblings which exist.
+ */
+
+#define BINMANIFEST_MAGIC "GMB2"
+#define BINMANIFEST_PREAMBLE_SIZE 8
+#define BINMANIFEST_SIGNATURE_SIZE 64
+#define BINMANIFEST_HEADER_FIXED_SIZE 46
+#define BINMANIFEST_BUCKET_SIZE 8
+#define BINMANIFEST_HASH_SIZE 32
+/* Entries per bucket the compiler aims for */
+#define BINMANIFEST_BUCKET_ENTRIES 16
+/* Enough levels for any number of entries that fits into a u32 */
+#define BINMANIFEST_MAX_DEPTH 32
+
+
+static inline uint16_t binmanifest_get16(const unsigned char *p) {
+	return (uint16_t)p[0] << 8 | p[1];
+}
+
+static inline uint32_t binmanifest_get32(const unsigned char *p) {
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline void binmanifest_put16(unsigned char *p, uint16_t v) {
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static inline void binmanifest_put32(unsigned char *p, uint32_t v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+
+uint32_t binmanifest_bucket(const char *model, size_t len, uint32_t n_buckets);
+void binmanifest_leaf_hash(unsigned char out[BINMANIFEST_HASH_SIZE], const char *line, size_t len);
+void binmanifest_node_hash(unsigned char out[BINMANIFEST_HASH_SIZE], const unsigned char left[BINMANIFEST_HASH_SIZE], const unsigned char right[BINMANIFEST_HASH_SIZE]);
+bool binmanifest_verify_proof(const unsigned char root[BINMANIFEST_HASH_SIZE], uint32_t n_entries, uint32_t leaf_index,
+			      const unsigned char *proof, size_t depth, const char *line, size_t len);
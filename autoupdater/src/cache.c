@@ -0,0 +1,242 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "cache.h"
+#include "statefile.h"
+
+#include <hexutil.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/*
+ * The cache holds the hash of the last manifest which carried enough valid
+ * signatures, together with the fields parsed for our model.
+ */
+static const char *const cache_path = "/tmp/autoupdater.cache";
+static const char *const cache_tmp_path = "/tmp/autoupdater.cache.tmp";
+
+/*
+ * The validators file remembers the ETag and Last-Modified headers each
+ * mirror sent with its manifest, keyed by the manifest URL:
+ * <manifest hash> TAB <ETag> TAB <Last-Modified>
+ */
+static const char *const validators_path = "/tmp/autoupdater.validators";
+
+
+/**
+ * Hashes everything in the settings a signature check depends on, so the
+ * cache is invalidated when the branch, the keys or the quorum change.
+ */
+static void settings_digest(unsigned char out[HASH_SIZE], const struct settings *s) {
+	struct hash_ctx ctx;
+
+	hash_init(&ctx);
+	hash_update(&ctx, s->branch, strlen(s->branch) + 1);
+	hash_update(&ctx, &s->good_signatures, sizeof(s->good_signatures));
+	hash_update(&ctx, s->pubkeys, s->n_pubkeys * sizeof(ecc_25519_work_t));
+	hash_final(&ctx, out);
+}
+
+
+/**
+ * Fills the manifest with the fields cached for our model and returns the
+ * hash of the manifest they were taken from. Returns false if there is no
+ * usable cache for the current settings.
+ */
+bool manifest_cache_load(struct manifest *m, unsigned char hash[HASH_SIZE], const struct settings *s, const char *image_name) {
+	FILE *f = statefile_open(cache_path);
+	if (!f)
+		return false;
+
+	unsigned char digest[HASH_SIZE], cached_digest[HASH_SIZE];
+	settings_digest(digest, s);
+
+	bool hash_ok = false, settings_ok = false, model_ok = false;
+	bool imagesize_ok = false, image_hash_ok = false;
+	char *line = NULL;
+	size_t len = 0;
+
+	while (getline(&line, &len, f) >= 0) {
+		line[strcspn(line, "\n")] = '\0';
+
+		if (!strncmp(line, "HASH=", 5)) {
+			hash_ok = parsehex(hash, &line[5], HASH_SIZE);
+		}
+		else if (!strncmp(line, "SETTINGS=", 9)) {
+			settings_ok = parsehex(cached_digest, &line[9], HASH_SIZE) && !memcmp(digest, cached_digest, HASH_SIZE);
+		}
+		else if (!strncmp(line, "MODEL=", 6)) {
+			model_ok = !strcmp(&line[6], image_name);
+		}
+		else if (!strncmp(line, "VERSION=", 8)) {
+			free(m->version);
+			m->version = strdup(&line[8]);
+		}
+		else if (!strncmp(line, "FILENAME=", 9)) {
+			free(m->image_filename);
+			m->image_filename = strdup(&line[9]);
+		}
+		else if (!strncmp(line, "IMAGEHASH=", 10)) {
+			image_hash_ok = parsehex(m->image_hash, &line[10], HASH_SIZE);
+		}
+		else if (!strncmp(line, "IMAGESIZE=", 10)) {
+			char *end;
+			unsigned long long val = strtoull(&line[10], &end, 10);
+			imagesize_ok = !*end && val <= SSIZE_MAX;
+			m->imagesize = val;
+		}
+		else if (!strncmp(line, "DATE=", 5)) {
+			m->date = strtoll(&line[5], NULL, 10);
+			m->date_ok = true;
+		}
+		else if (!strncmp(line, "PRIORITY=", 9)) {
+			m->priority = strtof(&line[9], NULL);
+			m->priority_ok = true;
+		}
+	}
+
+	free(line);
+	fclose(f);
+
+	if (!hash_ok || !settings_ok || !model_ok || !imagesize_ok || !image_hash_ok ||
+	    !m->version || !m->image_filename || !m->date_ok || !m->priority_ok) {
+		clear_manifest(m);
+		return false;
+	}
+
+	m->branch_ok = true;
+	m->model_ok = true;
+	return true;
+}
+
+
+/** Remembers a manifest which passed the signature check and all other sanity checks */
+void manifest_cache_store(const struct manifest *m, const unsigned char hash[HASH_SIZE], const struct settings *s, const char *image_name) {
+	unsigned char digest[HASH_SIZE];
+	char hex[2*HASH_SIZE + 1];
+
+	settings_digest(digest, s);
+
+	int fd = open(cache_tmp_path, O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW|O_CLOEXEC, 0600);
+	if (fd < 0)
+		goto fail;
+
+	FILE *f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		goto fail_unlink;
+	}
+
+	formathex(hex, hash, HASH_SIZE);
+	fprintf(f, "HASH=%s\n", hex);
+	formathex(hex, digest, HASH_SIZE);
+	fprintf(f, "SETTINGS=%s\n", hex);
+	fprintf(f, "MODEL=%s\n", image_name);
+	fprintf(f, "VERSION=%s\n", m->version);
+	fprintf(f, "FILENAME=%s\n", m->image_filename);
+	formathex(hex, m->image_hash, HASH_SIZE);
+	fprintf(f, "IMAGEHASH=%s\n", hex);
+	fprintf(f, "IMAGESIZE=%zi\n", m->imagesize);
+	fprintf(f, "DATE=%lli\n", (long long)m->date);
+	fprintf(f, "PRIORITY=%.9g\n", m->priority);
+
+	if (fclose(f))
+		goto fail_unlink;
+
+	if (rename(cache_tmp_path, cache_path))
+		goto fail_unlink;
+
+	return;
+
+fail_unlink:
+	{
+		int err = errno;
+		unlink(cache_tmp_path);
+		errno = err;
+	}
+fail:
+	fprintf(stderr, "autoupdater: warning: unable to store manifest cache: %m\n");
+}
+
+
+/**
+ * Looks up the validators of the manifest last received from url and the
+ * hash of that manifest. Returns false if none are known.
+ */
+bool manifest_cache_get_validators(const char *url, struct http_validators *validators, unsigned char hash[HASH_SIZE]) {
+	char *value = statefile_get(validators_path, url);
+	if (!value)
+		return false;
+
+	bool ret = false;
+	char *ptr = value;
+	char *hash_str = strsep(&ptr, "\t");
+	char *etag = strsep(&ptr, "\t");
+	char *last_modified = strsep(&ptr, "\t");
+
+	if (last_modified && parsehex(hash, hash_str, HASH_SIZE)) {
+		http_validators_clear(validators);
+		if (*etag)
+			validators->etag = strdup(etag);
+		if (*last_modified)
+			validators->last_modified = strdup(last_modified);
+
+		ret = validators->etag || validators->last_modified;
+	}
+
+	free(value);
+
+	return ret;
+}
+
+
+/** Replaces the validators stored for url, removes them if validators is empty */
+void manifest_cache_set_validators(const char *url, const struct http_validators *validators, const unsigned char hash[HASH_SIZE]) {
+	const char *etag = validators->etag ?: "";
+	const char *last_modified = validators->last_modified ?: "";
+	char *value = NULL;
+
+	/* Header values can't contain newlines, but make sure they don't break the format */
+	if ((*etag || *last_modified) && !strpbrk(etag, "\t\n") && !strpbrk(last_modified, "\t\n")) {
+		char hex[2*HASH_SIZE + 1];
+		formathex(hex, hash, HASH_SIZE);
+
+		if (asprintf(&value, "%s\t%s\t%s", hex, etag, last_modified) < 0)
+			value = NULL;
+	}
+
+	if (!statefile_set(validators_path, url, value))
+		fprintf(stderr, "autoupdater: warning: unable to store manifest validators: %m\n");
+
+	free(value);
+}
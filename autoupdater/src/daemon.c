@@ -0,0 +1,216 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "daemon.h"
+#include "status.h"
+#include "util.h"
+
+#include <libubox/blobmsg.h>
+#include <libubox/uloop.h>
+#include <libubus.h>
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define DEFAULT_CHECK_INTERVAL 3600
+
+/* The first check after startup happens within this many seconds */
+#define STARTUP_SPREAD 300
+/* Delay after the WAN came up, to let routes and DNS settle */
+#define WAN_UP_DELAY 5
+#define WAN_UP_SPREAD 30
+
+
+/*
+ * The daemon keeps the settings, the decoded public keys and the ubus
+ * connection across checks. uloop only runs while waiting for the next
+ * check; the checks themselves run outside of any uloop callback, as
+ * they use the uloop on their own.
+ */
+struct daemon_state {
+	struct settings *s;
+	struct ubus_context *ubus;
+	struct ubus_event_handler iface_ev;
+	struct uloop_timeout timer;
+	uint32_t node_hash;
+
+	bool checking;
+	bool check_due;
+};
+
+static struct daemon_state daemon_state;
+static volatile sig_atomic_t terminate;
+
+
+static void handle_signal(int signo) {
+	terminate = 1;
+	uloop_end();
+}
+
+
+static void request_check(void) {
+	/* A check already running picks up everything that led to this request */
+	if (daemon_state.checking)
+		return;
+
+	daemon_state.check_due = true;
+	uloop_end();
+}
+
+
+static void timer_cb(struct uloop_timeout *t) {
+	request_check();
+}
+
+
+/** Schedules the next check, replacing the one scheduled before */
+static void schedule_check(unsigned long seconds) {
+	uloop_timeout_set(&daemon_state.timer, seconds * 1000);
+}
+
+
+/** Returns the time until the next regular check, varied by up to 10% */
+static unsigned long next_interval(void) {
+	unsigned long interval = daemon_state.s->check_interval ?: DEFAULT_CHECK_INTERVAL;
+	unsigned long jitter = interval / 10;
+
+	if (!jitter)
+		return interval;
+
+	return interval - jitter + random() % (2 * jitter + 1);
+}
+
+
+static int ubus_check(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req, const char *method, struct blob_attr *msg) {
+	request_check();
+	return UBUS_STATUS_OK;
+}
+
+static const struct ubus_method daemon_methods[] = {
+	UBUS_METHOD_NOARG("check", ubus_check),
+	UBUS_METHOD_NOARG("status", status_ubus_method),
+};
+
+static struct ubus_object_type daemon_object_type = UBUS_OBJECT_TYPE("autoupdater", daemon_methods);
+
+static struct ubus_object daemon_object = {
+	.name = "autoupdater",
+	.type = &daemon_object_type,
+	.methods = daemon_methods,
+	.n_methods = ARRAY_SIZE(daemon_methods),
+};
+
+
+/** Schedules a check shortly after the WAN interface came up */
+static void iface_event_cb(struct ubus_context *ctx, struct ubus_event_handler *ev, const char *type, struct blob_attr *msg) {
+	enum {
+		IFACE_ACTION,
+		IFACE_INTERFACE,
+		__IFACE_MAX,
+	};
+	const struct blobmsg_policy policy[__IFACE_MAX] = {
+		[IFACE_ACTION] = { .name = "action", .type = BLOBMSG_TYPE_STRING },
+		[IFACE_INTERFACE] = { .name = "interface", .type = BLOBMSG_TYPE_STRING },
+	};
+	struct blob_attr *tb[__IFACE_MAX];
+
+	blobmsg_parse(policy, __IFACE_MAX, tb, blob_data(msg), blob_len(msg));
+	if (!tb[IFACE_ACTION] || !tb[IFACE_INTERFACE])
+		return;
+
+	if (strcmp(blobmsg_get_string(tb[IFACE_ACTION]), "ifup"))
+		return;
+
+	const char *iface = blobmsg_get_string(tb[IFACE_INTERFACE]);
+	if (strcmp(iface, "wan") && strcmp(iface, "wan6"))
+		return;
+
+	/* Nodes sharing an uplink see it come up at the same time, don't let them all check at once */
+	schedule_check(WAN_UP_DELAY + daemon_state.node_hash % WAN_UP_SPREAD);
+}
+
+
+static void connect_ubus(void) {
+	daemon_state.ubus = ubus_connect(NULL);
+	if (!daemon_state.ubus) {
+		fputs("autoupdater: warning: unable to connect to ubus, only checking periodically\n", stderr);
+		return;
+	}
+
+	ubus_add_uloop(daemon_state.ubus);
+
+	if (ubus_add_object(daemon_state.ubus, &daemon_object))
+		fputs("autoupdater: warning: unable to register ubus object\n", stderr);
+
+	daemon_state.iface_ev.cb = iface_event_cb;
+	if (ubus_register_event_handler(daemon_state.ubus, &daemon_state.iface_ev, "network.interface"))
+		fputs("autoupdater: warning: unable to subscribe to interface events\n", stderr);
+}
+
+
+/**
+ * Runs checks until terminated by SIGINT or SIGTERM. Checks happen every
+ * check_interval seconds, when the WAN interface comes up and when
+ * requested by calling the ubus method autoupdater.check.
+ */
+int run_daemon(struct settings *s, daemon_check_cb check) {
+	daemon_state.s = s;
+	daemon_state.node_hash = get_node_hash();
+	daemon_state.timer.cb = timer_cb;
+
+	/* Installed before uloop gets the chance to install its own handlers */
+	struct sigaction sa = { .sa_handler = handle_signal };
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	connect_ubus();
+
+	/* Nodes powered up together shouldn't check at the same time */
+	schedule_check(daemon_state.node_hash % STARTUP_SPREAD);
+
+	while (!terminate) {
+		uloop_run();
+		if (terminate || !daemon_state.check_due)
+			continue;
+
+		daemon_state.check_due = false;
+		daemon_state.checking = true;
+		check(s);
+		daemon_state.checking = false;
+
+		schedule_check(next_interval());
+	}
+
+	uloop_timeout_cancel(&daemon_state.timer);
+	if (daemon_state.ubus)
+		ubus_free(daemon_state.ubus);
+
+	return EXIT_SUCCESS;
+}
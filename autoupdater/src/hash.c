@@ -0,0 +1,360 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "hash.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+#include <linux/if_alg.h>
+
+#ifndef AF_ALG
+#define AF_ALG 38
+#endif
+
+
+/**** ecdsautil's portable implementation ***********************************/
+
+static bool ecdsa_available(void) {
+	return true;
+}
+
+static void ecdsa_init(struct hash_ctx *ctx) {
+	ecdsa_sha256_init(&ctx->ecdsa);
+}
+
+static void ecdsa_update(struct hash_ctx *ctx, const void *data, size_t len) {
+	ecdsa_sha256_update(&ctx->ecdsa, data, len);
+}
+
+static void ecdsa_final(struct hash_ctx *ctx, unsigned char *out) {
+	ecdsa_sha256_final(&ctx->ecdsa, out);
+}
+
+
+/**** Padding and buffering for block function backends ********************/
+
+static void block_init(struct hash_ctx *ctx) {
+	static const uint32_t initial_state[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+
+	memcpy(ctx->block.state, initial_state, sizeof(initial_state));
+	ctx->block.len = 0;
+}
+
+static void block_update(struct hash_ctx *ctx, const void *data, size_t len) {
+	const unsigned char *ptr = data;
+	size_t used = ctx->block.len % HASH_BLOCK_SIZE;
+
+	ctx->block.len += len;
+
+	if (used) {
+		size_t n = HASH_BLOCK_SIZE - used;
+		if (n > len)
+			n = len;
+
+		memcpy(ctx->block.buf + used, ptr, n);
+		ptr += n;
+		len -= n;
+
+		if (used + n < HASH_BLOCK_SIZE)
+			return;
+
+		ctx->backend->compress(ctx->block.state, ctx->block.buf, 1);
+	}
+
+	if (len >= HASH_BLOCK_SIZE) {
+		size_t nblocks = len / HASH_BLOCK_SIZE;
+		ctx->backend->compress(ctx->block.state, ptr, nblocks);
+		ptr += nblocks * HASH_BLOCK_SIZE;
+		len -= nblocks * HASH_BLOCK_SIZE;
+	}
+
+	memcpy(ctx->block.buf, ptr, len);
+}
+
+static void block_final(struct hash_ctx *ctx, unsigned char *out) {
+	uint64_t bits = ctx->block.len * 8;
+	size_t used = ctx->block.len % HASH_BLOCK_SIZE;
+
+	ctx->block.buf[used++] = 0x80;
+	if (used > HASH_BLOCK_SIZE - 8) {
+		memset(ctx->block.buf + used, 0, HASH_BLOCK_SIZE - used);
+		ctx->backend->compress(ctx->block.state, ctx->block.buf, 1);
+		used = 0;
+	}
+
+	memset(ctx->block.buf + used, 0, HASH_BLOCK_SIZE - 8 - used);
+	for (int i = 0; i < 8; i++)
+		ctx->block.buf[HASH_BLOCK_SIZE - 1 - i] = bits >> (8 * i);
+
+	ctx->backend->compress(ctx->block.state, ctx->block.buf, 1);
+
+	for (int i = 0; i < 8; i++) {
+		out[4*i] = ctx->block.state[i] >> 24;
+		out[4*i + 1] = ctx->block.state[i] >> 16;
+		out[4*i + 2] = ctx->block.state[i] >> 8;
+		out[4*i + 3] = ctx->block.state[i];
+	}
+}
+
+
+/**** Kernel crypto API ******************************************************/
+
+static const char *const proc_crypto = "/proc/crypto";
+
+/* Drivers which compute SHA256 on the CPU and don't gain anything from the syscall overhead */
+static const char *const software_drivers[] = {
+	"sha256-generic",
+	"sha256-lib",
+	"sha256-arm",
+	"sha256-arm64",
+	"sha256-arm64-neon",
+	"sha256-neon",
+	"sha256-ce",
+	"sha256-ssse3",
+	"sha256-avx",
+	"sha256-avx2",
+	"sha256-ni",
+	"sha256-octeon",
+};
+
+static int alg_open(void) {
+	struct sockaddr_alg sa = {
+		.salg_family = AF_ALG,
+		.salg_type = "hash",
+		.salg_name = "sha256",
+	};
+
+	int tfm = socket(AF_ALG, SOCK_SEQPACKET|SOCK_CLOEXEC, 0);
+	if (tfm < 0)
+		return -1;
+
+	if (bind(tfm, (struct sockaddr *)&sa, sizeof(sa))) {
+		close(tfm);
+		return -1;
+	}
+
+	int fd = accept4(tfm, NULL, 0, SOCK_CLOEXEC);
+	close(tfm);
+
+	return fd;
+}
+
+/** Returns true if the preferred sha256 implementation of the kernel is a hardware driver */
+static bool alg_hw_driver(void) {
+	FILE *f = fopen(proc_crypto, "r");
+	if (!f)
+		return false;
+
+	char line[128], name[64] = "", driver[64] = "", best[64] = "";
+	int priority, best_priority = -1;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "name : %63s", name) == 1)
+			continue;
+		if (sscanf(line, "driver : %63s", driver) == 1)
+			continue;
+		if (sscanf(line, "priority : %d", &priority) != 1)
+			continue;
+
+		if (!strcmp(name, "sha256") && priority > best_priority) {
+			best_priority = priority;
+			strcpy(best, driver);
+		}
+	}
+
+	fclose(f);
+
+	if (best_priority < 0)
+		return false;
+
+	for (size_t i = 0; i < sizeof(software_drivers) / sizeof(software_drivers[0]); i++) {
+		if (!strcmp(best, software_drivers[i]))
+			return false;
+	}
+
+	return true;
+}
+
+static bool alg_available(void) {
+	int fd = alg_open();
+	if (fd < 0)
+		return false;
+
+	close(fd);
+	return true;
+}
+
+static void alg_init(struct hash_ctx *ctx) {
+	ctx->alg.fd = alg_open();
+	ctx->alg.failed = ctx->alg.fd < 0;
+	if (ctx->alg.failed)
+		fprintf(stderr, "autoupdater: warning: failed to open AF_ALG socket: %s\n", strerror(errno));
+}
+
+static void alg_update(struct hash_ctx *ctx, const void *data, size_t len) {
+	const char *ptr = data;
+
+	while (len && !ctx->alg.failed) {
+		ssize_t r = send(ctx->alg.fd, ptr, len, MSG_MORE);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+
+			fprintf(stderr, "autoupdater: warning: failed to hash data using AF_ALG: %s\n", strerror(errno));
+			ctx->alg.failed = true;
+			break;
+		}
+
+		ptr += r;
+		len -= r;
+	}
+}
+
+static void alg_final(struct hash_ctx *ctx, unsigned char *out) {
+	/* A failed hash must never match anything, so leave no usable digest behind */
+	memset(out, 0, HASH_SIZE);
+
+	if (!ctx->alg.failed) {
+		if (read(ctx->alg.fd, out, HASH_SIZE) != HASH_SIZE) {
+			fprintf(stderr, "autoupdater: warning: failed to read hash from AF_ALG: %s\n", strerror(errno));
+			memset(out, 0, HASH_SIZE);
+		}
+	}
+
+	if (ctx->alg.fd >= 0)
+		close(ctx->alg.fd);
+}
+
+
+/**** Backend selection ******************************************************/
+
+static const struct hash_backend backends[] = {
+	{
+		.name = "shani",
+		.available = hash_shani_supported,
+		.init = block_init,
+		.update = block_update,
+		.final = block_final,
+		.compress = hash_compress_shani,
+	},
+	{
+		.name = "armce",
+		.available = hash_armce_supported,
+		.init = block_init,
+		.update = block_update,
+		.final = block_final,
+		.compress = hash_compress_armce,
+	},
+	{
+		.name = "afalg",
+		.available = alg_available,
+		.init = alg_init,
+		.update = alg_update,
+		.final = alg_final,
+	},
+	{
+		.name = "ecdsautil",
+		.available = ecdsa_available,
+		.init = ecdsa_init,
+		.update = ecdsa_update,
+		.final = ecdsa_final,
+	},
+};
+
+#define N_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+static const struct hash_backend *backend = &backends[N_BACKENDS - 1];
+
+
+/**
+ * Selects the hash backend by name. "auto" prefers CPU extensions, then
+ * hardware crypto engines exposed by the kernel, and falls back to the
+ * portable implementation.
+ */
+bool hash_select(const char *name) {
+	if (!name || !strcmp(name, "auto")) {
+		for (size_t i = 0; i < N_BACKENDS; i++) {
+			if (backends[i].init == alg_init && !alg_hw_driver())
+				continue;
+
+			if (backends[i].available()) {
+				backend = &backends[i];
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	for (size_t i = 0; i < N_BACKENDS; i++) {
+		if (strcmp(backends[i].name, name))
+			continue;
+
+		if (!backends[i].available()) {
+			fprintf(stderr, "autoupdater: warning: hash backend '%s' is not available on this system\n", name);
+			return false;
+		}
+
+		backend = &backends[i];
+		return true;
+	}
+
+	fprintf(stderr, "autoupdater: warning: unknown hash backend '%s'\n", name);
+	return false;
+}
+
+const char * hash_backend_name(void) {
+	return backend->name;
+}
+
+/** Returns all backends, available on this system or not */
+const struct hash_backend * hash_get_backends(size_t *n) {
+	*n = N_BACKENDS;
+	return backends;
+}
+
+
+void hash_init(struct hash_ctx *ctx) {
+	ctx->backend = backend;
+	backend->init(ctx);
+}
+
+void hash_update(struct hash_ctx *ctx, const void *data, size_t len) {
+	ctx->backend->update(ctx, data, len);
+}
+
+void hash_final(struct hash_ctx *ctx, unsigned char *out) {
+	ctx->backend->final(ctx, out);
+}
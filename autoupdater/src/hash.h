@@ -0,0 +1,89 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+
+#include <ecdsautil/sha256.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define HASH_SIZE ECDSA_SHA256_HASH_SIZE
+#define HASH_BLOCK_SIZE 64
+
+
+/* Compresses nblocks consecutive 64 byte blocks into the SHA256 state */
+typedef void (*hash_compress_fn)(uint32_t state[8], const unsigned char *data, size_t nblocks);
+
+struct hash_ctx {
+	const struct hash_backend *backend;
+
+	union {
+		ecdsa_sha256_context_t ecdsa;
+
+		struct {
+			uint32_t state[8];
+			uint64_t len;
+			unsigned char buf[HASH_BLOCK_SIZE];
+		} block;
+
+		struct {
+			int fd;
+			bool failed;
+		} alg;
+	};
+};
+
+struct hash_backend {
+	const char *name;
+	/* Returns true if the backend can be used on this system */
+	bool (*available)(void);
+
+	void (*init)(struct hash_ctx *ctx);
+	void (*update)(struct hash_ctx *ctx, const void *data, size_t len);
+	void (*final)(struct hash_ctx *ctx, unsigned char *out);
+
+	/* Used by backends which only provide the block function */
+	hash_compress_fn compress;
+};
+
+
+/* Compression functions using CPU extensions, defined in hash_*.c */
+bool hash_shani_supported(void);
+void hash_compress_shani(uint32_t state[8], const unsigned char *data, size_t nblocks);
+
+bool hash_armce_supported(void);
+void hash_compress_armce(uint32_t state[8], const unsigned char *data, size_t nblocks);
+
+
+bool hash_select(const char *name);
+const char * hash_backend_name(void);
+const struct hash_backend * hash_get_backends(size_t *n);
+
+void hash_init(struct hash_ctx *ctx);
+void hash_update(struct hash_ctx *ctx, const void *data, size_t len);
+void hash_final(struct hash_ctx *ctx, unsigned char *out);
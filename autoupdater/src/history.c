@@ -0,0 +1,215 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "history.h"
+#include "statefile.h"
+#include "util.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+ * A log of the most recent requests to the mirrors, kept as a ring of
+ * HISTORY_SIZE lines:
+ * <mirror> TAB <m|i> TAB <time to first byte, ms> TAB <throughput, B/s> TAB <ok|fail>
+ *
+ * The kind is m for manifests and i for images. The time to first byte is
+ * -1 if no response arrived, the throughput is - if there was no body to
+ * measure (HTTP 304).
+ *
+ * Manifests are small and mostly not modified, so they tell how far away a
+ * mirror is, but not how fast it delivers. Mirrors are therefore ranked by
+ * the throughput of their image downloads where there are any, and by
+ * their time to first byte over all requests otherwise.
+ */
+static const char *const history_path = "/tmp/autoupdater.history";
+
+#define HISTORY_SIZE 64
+/* Chance of trying a mirror other than the best known one first */
+#define HISTORY_EPSILON 0.1
+/* Time to first byte counted for a request that got no response at all */
+#define HISTORY_FAILED_TTFB_MSEC 10000
+
+
+/** Appends a finished request to a mirror to the history */
+void history_record(const char *name, enum history_kind kind, const struct url_request *req, bool ok) {
+	if (strpbrk(name, "\t\n"))
+		return;
+
+	long ttfb = -1;
+	if (req->d.header_time > 0)
+		ttfb = lround((req->d.header_time - req->d.start_time) * 1000);
+
+	char throughput[32] = "-";
+	if (!ok)
+		strcpy(throughput, "0");
+	else if (req->d.downloaded > 0)
+		snprintf(throughput, sizeof(throughput), "%.0f", url_request_throughput(req));
+
+	char line[1024];
+	if ((size_t)snprintf(line, sizeof(line), "%s\t%c\t%ld\t%s\t%s",
+	                     name, kind == HISTORY_IMAGE ? 'i' : 'm', ttfb,
+	                     throughput, ok ? "ok" : "fail") >= sizeof(line))
+		return;
+
+	if (!statefile_append(history_path, line, HISTORY_SIZE))
+		fprintf(stderr, "autoupdater: warning: unable to store mirror history: %m\n");
+}
+
+
+struct mirror_score {
+	const char *name;
+	unsigned long requests;
+	double ttfb;
+	double image_throughput;
+	unsigned long images;
+};
+
+static double mean_ttfb(const struct mirror_score *score) {
+	return score->ttfb / score->requests;
+}
+
+static double mean_image_throughput(const struct mirror_score *score) {
+	return score->image_throughput / score->images;
+}
+
+/**
+ * Mirrors nobody has asked yet come first, then those which delivered
+ * images, fastest first, and then the others, quickest to respond first
+ */
+static int compare_score(const void *a, const void *b) {
+	const struct mirror_score *sa = a, *sb = b;
+
+	if (!sa->requests || !sb->requests)
+		return (sa->requests > 0) - (sb->requests > 0);
+
+	if (!sa->images != !sb->images)
+		return (sa->images == 0) - (sb->images == 0);
+
+	if (sa->images) {
+		double ta = mean_image_throughput(sa), tb = mean_image_throughput(sb);
+		return (ta < tb) - (ta > tb);
+	}
+
+	double ta = mean_ttfb(sa), tb = mean_ttfb(sb);
+	return (ta > tb) - (ta < tb);
+}
+
+static void load_scores(struct mirror_score *scores, size_t n) {
+	FILE *f = statefile_open(history_path);
+	if (!f)
+		return;
+
+	char *line = NULL;
+	size_t len = 0;
+
+	while (getline(&line, &len, f) >= 0) {
+		char *saveptr;
+		const char *name = strtok_r(line, "\t", &saveptr);
+		const char *kind = strtok_r(NULL, "\t", &saveptr);
+		const char *ttfb = strtok_r(NULL, "\t", &saveptr);
+		const char *throughput = strtok_r(NULL, "\t", &saveptr);
+		const char *result = strtok_r(NULL, "\t\n", &saveptr);
+		if (!result)
+			continue;
+
+		for (size_t i = 0; i < n; i++) {
+			if (strcmp(scores[i].name, name))
+				continue;
+
+			double ms = strtod(ttfb, NULL);
+			scores[i].ttfb += ms >= 0 ? ms : HISTORY_FAILED_TTFB_MSEC;
+			scores[i].requests++;
+
+			/* Failed downloads count as no throughput at all */
+			if (!strcmp(kind, "i") && strcmp(throughput, "-")) {
+				scores[i].image_throughput += strtod(throughput, NULL);
+				scores[i].images++;
+			}
+			break;
+		}
+	}
+
+	free(line);
+	fclose(f);
+}
+
+/**
+ * Orders mirrors by the throughput they are expected to deliver, see
+ * compare_score(). Mirrors without any history come first, so they get
+ * measured, and now and then a random mirror is moved to the front to
+ * notice when things change.
+ */
+void history_rank(const char **names, size_t n) {
+	if (n < 2)
+		return;
+
+	struct mirror_score *scores = safe_malloc(n * sizeof(*scores));
+
+	/* Shuffle first, so mirrors with equal scores are tried in random order */
+	for (size_t i = n; i > 1; i--) {
+		size_t j = random() % i;
+		const char *tmp = names[i-1];
+		names[i-1] = names[j];
+		names[j] = tmp;
+	}
+
+	for (size_t i = 0; i < n; i++)
+		scores[i] = (struct mirror_score){ .name = names[i] };
+
+	load_scores(scores, n);
+
+	/* Insertion sort, which unlike qsort() keeps the shuffled order of equal scores */
+	for (size_t i = 1; i < n; i++) {
+		struct mirror_score score = scores[i];
+		size_t j = i;
+		while (j > 0 && compare_score(&scores[j-1], &score) > 0) {
+			scores[j] = scores[j-1];
+			j--;
+		}
+		scores[j] = score;
+	}
+
+	if (scores[0].requests && random() < RAND_MAX * HISTORY_EPSILON) {
+		size_t j = 1 + random() % (n - 1);
+		struct mirror_score score = scores[j];
+		memmove(&scores[1], &scores[0], j * sizeof(*scores));
+		scores[0] = score;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		names[i] = scores[i].name;
+		if (scores[i].images)
+			printf("Mirror %s: %.0f B/s on average over %lu image downloads\n", names[i], mean_image_throughput(&scores[i]), scores[i].images);
+		else if (scores[i].requests)
+			printf("Mirror %s: %.0f ms to first byte on average over %lu requests\n", names[i], mean_ttfb(&scores[i]), scores[i].requests);
+	}
+
+	free(scores);
+}
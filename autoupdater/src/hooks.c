@@ -0,0 +1,216 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "hooks.h"
+#include "trace.h"
+#include "util.h"
+
+#include <libubox/uloop.h>
+
+#include <glob.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+
+struct hook_group;
+
+struct hook {
+	struct uloop_process proc;
+	struct uloop_timeout timeout;
+	struct hook_group *group;
+	char *path;
+	double start;
+	bool killed;
+};
+
+/* Hooks running in parallel */
+struct hook_group {
+	struct hook *hooks;
+	size_t n_hooks;
+	size_t running;
+	struct uloop_timeout reap;
+};
+
+
+static void hook_finish(struct hook *h, int wstatus) {
+	uloop_timeout_cancel(&h->timeout);
+
+	if (h->killed)
+		fprintf(stderr, "autoupdater: warning: %s did not finish within %u seconds and was killed\n", h->path, HOOK_TIMEOUT);
+	else if (!WIFEXITED(wstatus))
+		fprintf(stderr, "autoupdater: warning: execution of %s exited abnormally\n", h->path);
+	else if (WEXITSTATUS(wstatus))
+		fprintf(stderr, "autoupdater: warning: execution of %s exited with status code %d\n", h->path, WEXITSTATUS(wstatus));
+
+	fprintf(stderr, "autoupdater: info: %s took %.2f seconds\n", h->path, get_time() - h->start);
+
+	if (!--h->group->running)
+		uloop_end();
+}
+
+static void hook_exit_cb(struct uloop_process *p, int wstatus) {
+	hook_finish(container_of(p, struct hook, proc), wstatus);
+}
+
+static void hook_timeout_cb(struct uloop_timeout *t) {
+	struct hook *h = container_of(t, struct hook, timeout);
+
+	h->killed = true;
+	kill(-h->proc.pid, SIGKILL);
+}
+
+/**
+ * uloop only learns about children exiting while it is running, so the
+ * hooks that finished before it was started are collected here
+ */
+static void reap_cb(struct uloop_timeout *t) {
+	struct hook_group *group = container_of(t, struct hook_group, reap);
+
+	for (size_t i = 0; i < group->n_hooks; i++) {
+		struct hook *h = &group->hooks[i];
+		int wstatus;
+
+		if (!h->proc.pending || waitpid(h->proc.pid, &wstatus, WNOHANG) != h->proc.pid)
+			continue;
+
+		uloop_process_delete(&h->proc);
+		hook_finish(h, wstatus);
+	}
+}
+
+
+/**
+ * Starts a hook in a process group of its own, so it can be killed with all
+ * its children. posix_spawn() doesn't copy our address space, unlike fork().
+ */
+static bool hook_spawn(struct hook *h) {
+	posix_spawnattr_t attr;
+	sigset_t signals;
+
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP|POSIX_SPAWN_SETSIGMASK|POSIX_SPAWN_SETSIGDEF);
+	posix_spawnattr_setpgroup(&attr, 0);
+
+	sigemptyset(&signals);
+	posix_spawnattr_setsigmask(&attr, &signals);
+
+	/* uloop ignores SIGPIPE, the hooks shouldn't */
+	sigfillset(&signals);
+	posix_spawnattr_setsigdefault(&attr, &signals);
+
+	char *const argv[] = { h->path, NULL };
+	int err = posix_spawn(&h->proc.pid, h->path, NULL, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+
+	if (err) {
+		fprintf(stderr, "autoupdater: warning: failed to run %s: %s\n", h->path, strerror(err));
+		return false;
+	}
+
+	return true;
+}
+
+/** Runs hooks in parallel and waits until all of them have finished or were killed */
+static void run_group(char **paths, size_t n) {
+	struct hook_group group = {
+		.hooks = safe_malloc(n * sizeof(*group.hooks)),
+		.reap.cb = reap_cb,
+	};
+
+	for (size_t i = 0; i < n; i++) {
+		if (access(paths[i], X_OK) < 0)
+			continue;
+
+		struct hook *h = &group.hooks[group.n_hooks];
+		*h = (struct hook){
+			.proc.cb = hook_exit_cb,
+			.timeout.cb = hook_timeout_cb,
+			.group = &group,
+			.path = paths[i],
+			.start = get_time(),
+		};
+
+		if (!hook_spawn(h))
+			continue;
+
+		uloop_process_add(&h->proc);
+		uloop_timeout_set(&h->timeout, HOOK_TIMEOUT * 1000);
+		group.n_hooks++;
+		group.running++;
+	}
+
+	if (group.running)
+		uloop_timeout_set(&group.reap, 0);
+
+	while (group.running)
+		uloop_run();
+
+	uloop_timeout_cancel(&group.reap);
+	free(group.hooks);
+}
+
+
+/** Runs the executable files in a directory in parallel */
+static void run_parallel(const char *dir) {
+	char pat[strlen(dir) + 3];
+	sprintf(pat, "%s/*", dir);
+	glob_t globbuf;
+	if (glob(pat, 0, NULL, &globbuf))
+		return;
+
+	run_group(globbuf.gl_pathv, globbuf.gl_pathc);
+	globfree(&globbuf);
+}
+
+
+void run_dir(const char *dir) {
+	char pat[strlen(dir) + 3];
+	sprintf(pat, "%s/*", dir);
+	glob_t globbuf;
+	if (glob(pat, 0, NULL, &globbuf))
+		return;
+
+	struct trace_span span;
+	trace_span_start(&span);
+
+	for (size_t i = 0; i < globbuf.gl_pathc; i++) {
+		struct stat st;
+
+		if (!stat(globbuf.gl_pathv[i], &st) && S_ISDIR(st.st_mode))
+			run_parallel(globbuf.gl_pathv[i]);
+		else
+			run_group(&globbuf.gl_pathv[i], 1);
+	}
+
+	trace_span_stop(&span, TRACE_HOOKS);
+	globfree(&globbuf);
+}
@@ -23,10 +23,11 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
-#include "hexutil.h"
 #include "manifest.h"
 #include "util.h"
 
+#include <hexutil.h>
+
 #include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
@@ -78,8 +79,16 @@ static bool parse_rfc3339(const char *input, time_t *date) {
 }
 
 
+/** Parses a complete line, without hashing it */
 void parse_line(char *line, struct manifest *m, const char *branch, const char *image_name) {
 	if (m->sep_found) {
+		if (m->n_signatures >= MANIFEST_MAX_SIGNATURES) {
+			if (!m->signatures_capped)
+				fprintf(stderr, "autoupdater: warning: ignoring signatures beyond the first %u\n", MANIFEST_MAX_SIGNATURES);
+			m->signatures_capped = true;
+			return;
+		}
+
 		ecdsa_signature_t *sig = safe_malloc(sizeof(ecdsa_signature_t));
 
 		if (!parsehex(sig, line, sizeof(*sig))) {
@@ -93,9 +102,6 @@ void parse_line(char *line, struct manifest *m, const char *branch, const char *
 	} else if (strcmp(line, "---") == 0) {
 		m->sep_found = true;
 	} else {
-		ecdsa_sha256_update(&m->hash_ctx, line, strlen(line));
-		ecdsa_sha256_update(&m->hash_ctx, "\n", 1);
-
 		if (!strncmp(line, "BRANCH=", 7) && !strcmp(&line[7], branch)) {
 			m->branch_ok = true;
 		}
@@ -119,18 +125,19 @@ void parse_line(char *line, struct manifest *m, const char *branch, const char *
 			if (m->model_ok)
 				return;
 
-			char *model = strtok(line, " ");
-			char *version = strtok(NULL, " ");
-			char *checksum = strtok(NULL, " ");
-			char *imagesize = strtok(NULL, " ");
-			char *filename = strtok(NULL, " ");
-			if (!filename || strtok(NULL, " "))
+			char *saveptr;
+			char *model = strtok_r(line, " ", &saveptr);
+			char *version = strtok_r(NULL, " ", &saveptr);
+			char *checksum = strtok_r(NULL, " ", &saveptr);
+			char *imagesize = strtok_r(NULL, " ", &saveptr);
+			char *filename = strtok_r(NULL, " ", &saveptr);
+			if (!filename || strtok_r(NULL, " ", &saveptr))
 				return;
 
 			if (strcmp(model, image_name) != 0)
 				return;
 
-			if (!parsehex(m->image_hash, checksum, ECDSA_SHA256_HASH_SIZE))
+			if (!parsehex(m->image_hash, checksum, HASH_SIZE))
 				return;
 
 			{
@@ -152,3 +159,160 @@ void parse_line(char *line, struct manifest *m, const char *branch, const char *
 		}
 	}
 }
+
+
+/*
+ * The manifest is parsed as it comes in, in chunks of any size. Only lines
+ * which can matter are copied: the header fields, the line of our own
+ * model and the signatures. Whether a line matters is decided by its first
+ * few bytes; all other lines are skipped by looking for their end only, so
+ * neither their length nor the number of models costs memory.
+ *
+ * Everything in front of the separator is hashed as received, in whole
+ * chunks. The only bytes held back are those of a line which might still
+ * turn out to be the separator.
+ */
+
+static const char *const separator = "---";
+
+/* Upper bound for a single line we keep, protecting us from a hostile server */
+#define MAX_KEPT_LINE (64 * 1024)
+
+
+void manifest_parser_init(struct manifest_parser *p, struct manifest *m, const char *branch, const char *image_name) {
+	*p = (struct manifest_parser){
+		.m = m,
+		.branch = branch,
+		.image_name = image_name,
+		.image_name_len = strlen(image_name),
+		.state = MANIFEST_LINE_COLLECT,
+	};
+
+	/* Enough to tell the interesting lines from all others */
+	p->decide_len = p->image_name_len + 1;
+	if (p->decide_len < strlen("PRIORITY="))
+		p->decide_len = strlen("PRIORITY=");
+}
+
+
+void manifest_parser_free(struct manifest_parser *p) {
+	free(p->line);
+	p->line = NULL;
+	p->line_len = p->line_size = 0;
+}
+
+
+/** Checks whether the current line may still start with prefix */
+static bool may_start_with(const struct manifest_parser *p, const char *prefix, size_t len) {
+	return !memcmp(p->line, prefix, p->line_len < len ? p->line_len : len);
+}
+
+/** Checks whether the current line may still turn out to be the separator */
+static bool may_be_separator(const struct manifest_parser *p) {
+	return !p->m->sep_found && p->line_len <= strlen(separator) && may_start_with(p, separator, strlen(separator));
+}
+
+static bool line_wanted(const struct manifest_parser *p) {
+	if (p->m->sep_found || may_be_separator(p))
+		return true;
+
+	if (may_start_with(p, "BRANCH=", 7) || may_start_with(p, "DATE=", 5) || may_start_with(p, "PRIORITY=", 9))
+		return true;
+
+	if (p->m->model_ok || !may_start_with(p, p->image_name, p->image_name_len))
+		return false;
+
+	return p->line_len <= p->image_name_len || p->line[p->image_name_len] == ' ';
+}
+
+static bool line_append(struct manifest_parser *p, const char *data, size_t len) {
+	if (p->line_len + len >= MAX_KEPT_LINE) {
+		fprintf(stderr, "autoupdater: warning: skipping manifest line longer than %u bytes\n", MAX_KEPT_LINE);
+		return false;
+	}
+
+	if (p->line_len + len >= p->line_size) {
+		p->line_size = 2 * (p->line_len + len) + 64;
+		p->line = safe_realloc(p->line, p->line_size);
+	}
+
+	memcpy(p->line + p->line_len, data, len);
+	p->line_len += len;
+	return true;
+}
+
+/** Hashes the bytes of the current line held back in a previous chunk, once it can't be the separator anymore */
+static void hash_held_back(struct manifest_parser *p) {
+	if (!p->held_back)
+		return;
+
+	hash_update(&p->m->hash_ctx, p->line, p->held_back);
+	p->held_back = 0;
+}
+
+
+/** Feeds the next chunk of the manifest to the parser */
+void manifest_parser_feed(struct manifest_parser *p, const char *buf, size_t len) {
+	const char *end = buf + len;
+	const char *pos = buf;
+	/* Start of the bytes of this chunk which haven't been hashed yet, and of the current line */
+	const char *hash_from = buf, *line_start = buf;
+
+	while (pos < end) {
+		const char *nl = memchr(pos, '\n', end - pos);
+		const char *eol = nl ? nl : end;
+
+		if (p->state == MANIFEST_LINE_SKIP) {
+			if (!nl)
+				break;
+
+			pos = line_start = nl + 1;
+			p->state = MANIFEST_LINE_COLLECT;
+			continue;
+		}
+
+		/* Look at the first few bytes only until we know whether the line is of interest */
+		size_t n = eol - pos;
+		if (p->line_len < p->decide_len && n > p->decide_len - p->line_len)
+			n = p->decide_len - p->line_len;
+
+		if (!line_append(p, pos, n) || !line_wanted(p) ||
+		    !line_append(p, pos + n, eol - pos - n)) {
+			hash_held_back(p);
+			p->line_len = 0;
+			p->state = MANIFEST_LINE_SKIP;
+			continue;
+		}
+		pos = eol;
+
+		if (!nl)
+			break;
+
+		pos = nl + 1;
+
+		if (may_be_separator(p) && p->line_len == strlen(separator)) {
+			/* Everything in front of the separator is signed */
+			hash_update(&p->m->hash_ctx, hash_from, line_start - hash_from);
+			p->held_back = 0;
+			p->m->sep_found = true;
+		} else {
+			hash_held_back(p);
+			p->line[p->line_len] = '\0';
+			parse_line(p->line, p->m, p->branch, p->image_name);
+		}
+
+		p->line_len = 0;
+		line_start = pos;
+	}
+
+	if (p->m->sep_found)
+		return;
+
+	/* Hold back what might be the beginning of the separator */
+	if (p->state == MANIFEST_LINE_COLLECT && p->line_len && may_be_separator(p)) {
+		hash_update(&p->m->hash_ctx, hash_from, line_start - hash_from);
+		p->held_back = p->line_len;
+	} else {
+		hash_update(&p->m->hash_ctx, hash_from, end - hash_from);
+	}
+}
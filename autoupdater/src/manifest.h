@@ -25,8 +25,9 @@
 #pragma once
 
 
+#include "hash.h"
+
 #include <ecdsautil/ecdsa.h>
-#include <ecdsautil/sha256.h>
 
 #include <sys/types.h>
 #include <stdbool.h>
@@ -39,8 +40,9 @@ struct manifest {
 	bool date_ok:1;
 	bool priority_ok:1;
 	bool model_ok:1;
+	bool signatures_capped:1;
 	char *image_filename;
-	unsigned char *image_hash[ECDSA_SHA256_HASH_SIZE];
+	unsigned char *image_hash[HASH_SIZE];
 	char *version;
 	time_t date;
 	float priority;
@@ -48,10 +50,39 @@ struct manifest {
 
 	size_t n_signatures;
 	ecdsa_signature_t **signatures;
-	ecdsa_sha256_context_t hash_ctx;
+	struct hash_ctx hash_ctx;
 };
 
 
-void clear_manifest(struct manifest *m);
+/* Signatures beyond this are ignored, bounding the memory and CPU time a manifest can take */
+#define MANIFEST_MAX_SIGNATURES 32
+
+
+enum manifest_line_state {
+	MANIFEST_LINE_COLLECT,
+	MANIFEST_LINE_SKIP,
+};
+
+/* Incremental parser, see manifest_parser_feed() */
+struct manifest_parser {
+	struct manifest *m;
+	const char *branch;
+	const char *image_name;
+	size_t image_name_len;
+	size_t decide_len;
 
+	enum manifest_line_state state;
+	char *line;
+	size_t line_len;
+	size_t line_size;
+	/* leading bytes of the current line not hashed yet */
+	size_t held_back;
+};
+
+
+void clear_manifest(struct manifest *m);
 void parse_line(char *line, struct manifest *m, const char *branch, const char *image_name);
+
+void manifest_parser_init(struct manifest_parser *p, struct manifest *m, const char *branch, const char *image_name);
+void manifest_parser_feed(struct manifest_parser *p, const char *buf, size_t len);
+void manifest_parser_free(struct manifest_parser *p);
@@ -0,0 +1,211 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "neighbour.h"
+#include "util.h"
+#include "version.h"
+
+#include <libmeshneighbour.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const char *const originators_path = "/sys/kernel/debug/batman_adv/bat0/originators";
+
+
+void neighbour_info_free(struct neighbour_info *info) {
+	if (!info)
+		return;
+
+	version_key_free(&info->version_key);
+	free(info->version);
+	free(info);
+}
+
+
+/** Derives the MAC address from an EUI-64 based IPv6 link-local address */
+static bool ll_addr_to_mac(const struct in6_addr *addr, unsigned char mac[6]) {
+	const unsigned char *a = addr->s6_addr;
+
+	if (a[0] != 0xfe || (a[1] & 0xc0) != 0x80 || a[11] != 0xff || a[12] != 0xfe)
+		return false;
+
+	mac[0] = a[8] ^ 0x02;
+	mac[1] = a[9];
+	mac[2] = a[10];
+	mac[3] = a[13];
+	mac[4] = a[14];
+	mac[5] = a[15];
+
+	return true;
+}
+
+
+/**
+ * Looks up the TQ of the links to all neighbours in the batman-adv
+ * originator table. The TQ of a neighbour is the best TQ of any originator
+ * it is the next hop for, which is the one of its own originator entry
+ * unless it is reached indirectly. Only B.A.T.M.A.N. IV provides a TQ.
+ */
+static void read_tq(struct list_head *neighbours) {
+	FILE *f = fopen(originators_path, "r");
+	if (!f)
+		return;
+
+	char *line = NULL;
+	size_t len = 0;
+	bool batman_iv = false;
+
+	while (getline(&line, &len, f) >= 0) {
+		if (strstr(line, "(#/255)")) {
+			batman_iv = true;
+			continue;
+		}
+
+		if (!batman_iv)
+			continue;
+
+		/* Skip the marker of the best route */
+		char *ptr = line + strspn(line, " *");
+
+		unsigned int nh[6];
+		int tq;
+		if (sscanf(ptr, "%*s %*s (%d) %x:%x:%x:%x:%x:%x", &tq, &nh[0], &nh[1], &nh[2], &nh[3], &nh[4], &nh[5]) != 7)
+			continue;
+
+		struct mesh_neighbour *neigh;
+		list_for_each_entry(neigh, neighbours, list) {
+			struct neighbour_info *info = neigh->priv;
+			unsigned char mac[6];
+
+			if (!ll_addr_to_mac(&neigh->addr, mac))
+				continue;
+
+			bool match = true;
+			for (size_t i = 0; i < 6; i++)
+				match = match && mac[i] == nh[i];
+
+			if (match && tq > info->tq)
+				info->tq = tq;
+		}
+	}
+
+	free(line);
+	fclose(f);
+}
+
+
+static bool is_wired(const struct mesh_neighbour *neigh) {
+	return neigh->iface->proto && !strcmp(neigh->iface->proto, "gluon_wired");
+}
+
+
+/**
+ * Scores the link to a neighbour. The estimated delivery ratio is reduced
+ * by the reply RTT: 50 ms halve the score. Wired links count as lossless
+ * and always beat mesh links.
+ */
+static double link_score(const struct mesh_neighbour *neigh) {
+	const struct neighbour_info *info = neigh->priv;
+	bool wired = is_wired(neigh);
+
+	double quality;
+	if (wired)
+		quality = 1;
+	else if (info->tq >= 0)
+		quality = info->tq / 255.0;
+	else
+		quality = 0.5;
+
+	double score = quality / (1 + neigh->rtt_us / 50000.0);
+	return wired ? 1 + score : score;
+}
+
+
+struct ranked_neighbour {
+	struct mesh_neighbour *neigh;
+	double score;
+};
+
+static int compare_neighbours(const void *p1, const void *p2) {
+	const struct ranked_neighbour *a = p1, *b = p2;
+
+	/* The newest firmware comes first, unknown versions last */
+	const struct neighbour_info *ia = a->neigh->priv, *ib = b->neigh->priv;
+	if (!ia->version != !ib->version)
+		return ia->version ? -1 : 1;
+
+	if (ia->version) {
+		int cmp = version_key_compare(&ia->version_key, &ib->version_key);
+		if (cmp)
+			return -cmp;
+	}
+
+	/* Prefer the better link among neighbours running the same firmware */
+	if (a->score != b->score)
+		return a->score > b->score ? -1 : 1;
+
+	return 0;
+}
+
+
+/** Sorts the neighbours newest firmware first, best link first among equal versions */
+void rank_neighbours(struct list_head *neighbours) {
+	size_t n = 0;
+	struct mesh_neighbour *neigh, *next;
+	list_for_each_entry(neigh, neighbours, list)
+		n++;
+
+	if (n < 2)
+		return;
+
+	read_tq(neighbours);
+
+	struct ranked_neighbour *ranked = safe_malloc(n * sizeof(*ranked));
+	size_t i = 0;
+	list_for_each_entry_safe(neigh, next, neighbours, list) {
+		ranked[i].neigh = neigh;
+		ranked[i].score = link_score(neigh);
+		list_del(&neigh->list);
+		i++;
+	}
+
+	qsort(ranked, n, sizeof(*ranked), compare_neighbours);
+
+	for (i = 0; i < n; i++) {
+		const struct neighbour_info *info = ranked[i].neigh->priv;
+		printf("Neighbour %s: %s, TQ %d, RTT %lu us, firmware %s\n",
+			ranked[i].neigh->nodeid, is_wired(ranked[i].neigh) ? "wired" : "mesh",
+			info->tq, ranked[i].neigh->rtt_us, info->version ?: "unknown");
+
+		list_add_tail(&ranked[i].neigh->list, neighbours);
+	}
+
+	free(ranked);
+}
@@ -0,0 +1,181 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "pipeline.h"
+#include "util.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+static int get_error(struct pipeline *p) {
+	return __atomic_load_n(&p->error, __ATOMIC_ACQUIRE);
+}
+
+static void set_error(struct pipeline *p, int err) {
+	__atomic_store_n(&p->error, err, __ATOMIC_RELEASE);
+}
+
+
+static void * pipeline_worker(void *arg) {
+	struct pipeline *p = arg;
+
+	while (true) {
+		while (sem_wait(&p->filled) && errno == EINTR)
+			;
+
+		struct pipeline_slot *slot = &p->slots[p->tail];
+		p->tail = (p->tail + 1) % PIPELINE_SLOTS;
+
+		/* An empty slot marks the end of the stream */
+		if (!slot->len)
+			break;
+
+		/* Keep draining after an error so the producer never blocks */
+		if (!get_error(p)) {
+			int err = p->sink(slot->data, slot->len, p->priv);
+			if (err)
+				set_error(p, err);
+		}
+
+		sem_post(&p->empty);
+	}
+
+	return NULL;
+}
+
+
+/** Starts the worker thread, returns false if the sink has to be called directly */
+static bool pipeline_start_worker(struct pipeline *p) {
+	if (sysconf(_SC_NPROCESSORS_ONLN) < 2)
+		return false;
+
+	if (sem_init(&p->filled, 0, 0))
+		return false;
+	if (sem_init(&p->empty, 0, PIPELINE_SLOTS))
+		goto fail_filled;
+
+	p->slots = safe_malloc(PIPELINE_SLOTS * sizeof(struct pipeline_slot));
+	if (pthread_create(&p->worker, NULL, pipeline_worker, p))
+		goto fail_slots;
+
+	return true;
+
+fail_slots:
+	free(p->slots);
+	p->slots = NULL;
+	sem_destroy(&p->empty);
+fail_filled:
+	sem_destroy(&p->filled);
+	return false;
+}
+
+
+void pipeline_init(struct pipeline *p, pipeline_sink sink, void *priv) {
+	p->sink = sink;
+	p->priv = priv;
+	p->cur = NULL;
+	p->head = p->tail = 0;
+	p->error = 0;
+
+	p->threaded = pipeline_start_worker(p);
+
+	/* Without a worker, one slot is filled and drained in turn */
+	if (!p->threaded)
+		p->slots = safe_malloc(sizeof(struct pipeline_slot));
+}
+
+
+/** Hands the current slot to the sink */
+static void pipeline_push(struct pipeline *p) {
+	if (p->threaded) {
+		p->head = (p->head + 1) % PIPELINE_SLOTS;
+		sem_post(&p->filled);
+	} else if (!get_error(p) && p->cur->len) {
+		int err = p->sink(p->cur->data, p->cur->len, p->priv);
+		if (err)
+			set_error(p, err);
+	}
+
+	p->cur = NULL;
+}
+
+
+/**
+ * Returns a buffer of *len bytes the next chunk of data can be read into.
+ * Blocks if all slots are currently waiting for the worker.
+ */
+char * pipeline_buffer(struct pipeline *p, size_t *len) {
+	if (!p->cur) {
+		if (p->threaded) {
+			while (sem_wait(&p->empty) && errno == EINTR)
+				;
+			p->cur = &p->slots[p->head];
+		} else {
+			p->cur = &p->slots[0];
+		}
+		p->cur->len = 0;
+	}
+
+	*len = PIPELINE_SLOT_SIZE - p->cur->len;
+	return p->cur->data + p->cur->len;
+}
+
+
+/** Accounts len bytes written to the buffer returned by \ref pipeline_buffer */
+int pipeline_commit(struct pipeline *p, size_t len) {
+	p->cur->len += len;
+	if (p->cur->len == PIPELINE_SLOT_SIZE)
+		pipeline_push(p);
+
+	return get_error(p);
+}
+
+
+/** Flushes all pending data, stops the worker and returns the first error of the sink */
+int pipeline_finish(struct pipeline *p) {
+	if (p->threaded) {
+		if (p->cur && p->cur->len)
+			pipeline_push(p);
+
+		/* Terminate the worker with an empty slot */
+		pipeline_buffer(p, &(size_t){0});
+		pipeline_push(p);
+
+		pthread_join(p->worker, NULL);
+		sem_destroy(&p->filled);
+		sem_destroy(&p->empty);
+		p->threaded = false;
+	} else if (p->cur) {
+		pipeline_push(p);
+	}
+
+	free(p->slots);
+	p->slots = NULL;
+
+	return get_error(p);
+}
@@ -0,0 +1,74 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+#define PIPELINE_SLOTS 8
+#define PIPELINE_SLOT_SIZE (16 * 1024)
+
+
+/* Consumes one chunk of data, returns 0 on success or an errno value */
+typedef int (*pipeline_sink)(const void *buf, size_t len, void *priv);
+
+struct pipeline_slot {
+	size_t len;
+	char data[PIPELINE_SLOT_SIZE];
+};
+
+/*
+ * Single-producer single-consumer ring of large buffers. The producer fills
+ * slots and hands them to a worker thread which feeds them to the sink, so
+ * the producer doesn't have to wait for the sink. On single-core systems
+ * only one slot is allocated, and the sink is called directly whenever it
+ * is full.
+ */
+struct pipeline {
+	pipeline_sink sink;
+	void *priv;
+
+	struct pipeline_slot *slots;
+	struct pipeline_slot *cur;
+	unsigned int head;
+	unsigned int tail;
+
+	bool threaded;
+	pthread_t worker;
+	sem_t filled;
+	sem_t empty;
+
+	int error;
+};
+
+
+void pipeline_init(struct pipeline *p, pipeline_sink sink, void *priv);
+char * pipeline_buffer(struct pipeline *p, size_t *len);
+int pipeline_commit(struct pipeline *p, size_t len);
+int pipeline_finish(struct pipeline *p);
@@ -26,9 +26,9 @@
 
 
 #include "settings.h"
-#include "hexutil.h"
 #include "util.h"
 
+#include <hexutil.h>
 #include <uci.h>
 
 #include <stdlib.h>
@@ -141,6 +141,31 @@ void load_settings(struct settings *settings) {
 	if (version_file)
 		settings->old_version = read_one_line(version_file);
 
+	settings->hash_backend = uci_lookup_option_string(ctx, s, "hash_backend");
+
+	const char *rollout = uci_lookup_option_string(ctx, s, "rollout");
+	if (rollout && !strcmp(rollout, "slot"))
+		settings->rollout_slots = true;
+	else if (rollout && strcmp(rollout, "random"))
+		fprintf(stderr, "autoupdater: warning: unknown rollout mode '%s', using 'random'\n", rollout);
+
+	const char *manifest_format = uci_lookup_option_string(ctx, s, "manifest_format");
+	if (manifest_format && !strcmp(manifest_format, "binary"))
+		settings->binary_manifest = true;
+	else if (manifest_format && strcmp(manifest_format, "text"))
+		fprintf(stderr, "autoupdater: warning: unknown manifest format '%s', using 'text'\n", manifest_format);
+
+	if (uci_lookup_option(ctx, s, "check_interval"))
+		settings->check_interval = load_positive_number(ctx, s, "check_interval");
+
+	if (uci_lookup_option(ctx, s, "rss_budget"))
+		settings->rss_budget = load_positive_number(ctx, s, "rss_budget");
+	if (uci_lookup_option(ctx, s, "cpu_budget"))
+		settings->cpu_budget = load_positive_number(ctx, s, "cpu_budget");
+
+	if (uci_lookup_option(ctx, s, "image_storage"))
+		settings->storage = load_string_list(ctx, s, "image_storage", &settings->n_storage);
+
 	if (!settings->branch)
 		settings->branch = uci_lookup_option_string(ctx, s, "branch");
 
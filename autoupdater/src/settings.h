@@ -34,8 +34,16 @@ struct settings {
 	bool fallback;
 	bool no_action;
 	bool force_version;
+	bool daemon;
+	bool rollout_slots;
+	bool binary_manifest;
 	const char *branch;
+	const char *hash_backend;
 	unsigned long good_signatures;
+	unsigned long check_interval;
+	/* peak RSS in KiB and CPU time in ms a run should stay within, 0 if unlimited */
+	unsigned long rss_budget;
+	unsigned long cpu_budget;
 	char *old_version;
 
 	size_t n_mirrors;
@@ -43,6 +51,9 @@ struct settings {
 
 	size_t n_pubkeys;
 	ecc_25519_work_t *pubkeys;
+
+	size_t n_storage;
+	const char **storage;
 };
 
 
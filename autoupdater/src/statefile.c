@@ -0,0 +1,235 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/*
+ * State kept between runs lives in small files in tmpfs, so it is
+ * discarded on reboot and never wears out the flash. Keyed state files
+ * hold one entry per line: the key, a tab and the value.
+ */
+
+
+#include "statefile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+
+/** Opens a state file for reading, unless somebody else could have written it */
+FILE * statefile_open(const char *path) {
+	int fd = open(path, O_RDONLY|O_NOFOLLOW|O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & (S_IWGRP|S_IWOTH))) {
+		close(fd);
+		return NULL;
+	}
+
+	FILE *f = fdopen(fd, "r");
+	if (!f)
+		close(fd);
+
+	return f;
+}
+
+
+static bool line_has_key(const char *line, const char *key, size_t key_len) {
+	return !strncmp(line, key, key_len) && line[key_len] == '\t';
+}
+
+
+/** Returns the value stored for key, to be freed by the caller, or NULL */
+char * statefile_get(const char *path, const char *key) {
+	FILE *f = statefile_open(path);
+	if (!f)
+		return NULL;
+
+	char *ret = NULL;
+	char *line = NULL;
+	size_t len = 0;
+	size_t key_len = strlen(key);
+
+	while (getline(&line, &len, f) >= 0) {
+		if (!line_has_key(line, key, key_len))
+			continue;
+
+		line[strcspn(line, "\n")] = '\0';
+		ret = strdup(line + key_len + 1);
+		break;
+	}
+
+	free(line);
+	fclose(f);
+
+	return ret;
+}
+
+
+/** Replaces the value stored for key, removes the entry if value is NULL */
+bool statefile_set(const char *path, const char *key, const char *value) {
+	if (strpbrk(key, "\t\n") || (value && strchr(value, '\n'))) {
+		errno = EINVAL;
+		return false;
+	}
+
+	char tmp_path[PATH_MAX];
+	if ((size_t)snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= sizeof(tmp_path)) {
+		errno = ENAMETOOLONG;
+		return false;
+	}
+
+	FILE *in = statefile_open(path);
+
+	int fd = open(tmp_path, O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW|O_CLOEXEC, 0600);
+	if (fd < 0)
+		goto fail;
+
+	FILE *out = fdopen(fd, "w");
+	if (!out) {
+		close(fd);
+		goto fail_unlink;
+	}
+
+	/* Copy all other entries */
+	if (in) {
+		char *line = NULL;
+		size_t len = 0;
+		size_t key_len = strlen(key);
+
+		while (getline(&line, &len, in) >= 0) {
+			if (!line_has_key(line, key, key_len))
+				fputs(line, out);
+		}
+
+		free(line);
+	}
+
+	if (value)
+		fprintf(out, "%s\t%s\n", key, value);
+
+	if (fclose(out))
+		goto fail_unlink;
+
+	if (rename(tmp_path, path))
+		goto fail_unlink;
+
+	if (in)
+		fclose(in);
+	return true;
+
+fail_unlink:
+	{
+		int err = errno;
+		unlink(tmp_path);
+		errno = err;
+	}
+fail:
+	if (in) {
+		int err = errno;
+		fclose(in);
+		errno = err;
+	}
+	return false;
+}
+
+
+/** Appends a line, dropping the oldest lines so that at most max_lines remain */
+bool statefile_append(const char *path, const char *line, size_t max_lines) {
+	if (!max_lines || strchr(line, '\n')) {
+		errno = EINVAL;
+		return false;
+	}
+
+	char tmp_path[PATH_MAX];
+	if ((size_t)snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= sizeof(tmp_path)) {
+		errno = ENAMETOOLONG;
+		return false;
+	}
+
+	FILE *in = statefile_open(path);
+
+	int fd = open(tmp_path, O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW|O_CLOEXEC, 0600);
+	if (fd < 0)
+		goto fail;
+
+	FILE *out = fdopen(fd, "w");
+	if (!out) {
+		close(fd);
+		goto fail_unlink;
+	}
+
+	/* Copy the newest max_lines - 1 lines */
+	if (in) {
+		char *buf = NULL;
+		size_t len = 0;
+		size_t n = 0;
+
+		while (getline(&buf, &len, in) >= 0)
+			n++;
+
+		rewind(in);
+
+		for (size_t i = 0; getline(&buf, &len, in) >= 0; i++) {
+			if (i + max_lines > n)
+				fputs(buf, out);
+		}
+
+		free(buf);
+	}
+
+	fprintf(out, "%s\n", line);
+
+	if (fclose(out))
+		goto fail_unlink;
+
+	if (rename(tmp_path, path))
+		goto fail_unlink;
+
+	if (in)
+		fclose(in);
+	return true;
+
+fail_unlink:
+	{
+		int err = errno;
+		unlink(tmp_path);
+		errno = err;
+	}
+fail:
+	if (in) {
+		int err = errno;
+		fclose(in);
+		errno = err;
+	}
+	return false;
+}
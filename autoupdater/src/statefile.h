@@ -1,5 +1,5 @@
 /*
-  Copyright (c) 2012, Nils Schneider <nils@nilsschneider.net>
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
   All rights reserved.
 
   Redistribution and use in source and binary forms, with or without
@@ -23,21 +23,16 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
-#include "hexutil.h"
+#pragma once
 
-#include <stdio.h>
-#include <string.h>
 
+#include <stdbool.h>
+#include <stdio.h>
 
-bool parsehex(void *output, const char *input, size_t len) {
-	unsigned char *buffer = output;
 
-	// number of digits must be 2 * len
-	if ((strspn(input, "0123456789abcdefABCDEF") != 2*len) || input[2*len])
-		return false;
+FILE * statefile_open(const char *path);
 
-	for (size_t i = 0; i < len; i++)
-		sscanf(&input[2*i], "%02hhx", &buffer[i]);
+char * statefile_get(const char *path, const char *key);
+bool statefile_set(const char *path, const char *key, const char *value);
 
-	return true;
-}
+bool statefile_append(const char *path, const char *line, size_t max_lines);
@@ -0,0 +1,187 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "status.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/*
+ * The state of the updater, published as the ubus method
+ * autoupdater.status. The daemon adds the method to its own object,
+ * single runs publish an object of their own while they last.
+ */
+
+/* Seconds between two updates of the download rate and the progress line */
+#define STATUS_INTERVAL 1.0
+
+
+static const char *const state_names[] = {
+	[STATUS_IDLE] = "idle",
+	[STATUS_MANIFEST] = "manifest",
+	[STATUS_DOWNLOADING] = "downloading",
+	[STATUS_VERIFYING] = "verifying",
+	[STATUS_UPGRADING] = "upgrading",
+};
+
+static struct {
+	enum status_state state;
+	char *source;
+	bool mirror;
+
+	ssize_t bytes;
+	ssize_t total;
+	/* bytes per second over the last STATUS_INTERVAL */
+	double rate;
+	double sample_time;
+	ssize_t sample_bytes;
+
+	/* wall clock time and outcome of the last finished check */
+	time_t last_check;
+	bool last_updated;
+	const char *last_result;
+} status;
+
+
+void status_set_state(enum status_state state) {
+	status.state = state;
+}
+
+/** Sets the mirror or neighbour the image is downloaded from and resets the progress */
+void status_set_source(const char *source, bool mirror) {
+	free(status.source);
+	status.source = strdup(source);
+	status.mirror = mirror;
+
+	status.bytes = 0;
+	status.total = -1;
+	status.rate = 0;
+	status.sample_time = get_time();
+	status.sample_bytes = 0;
+}
+
+static void print_progress(void) {
+	printf("\rDownloading image: % 5zi / %zi KiB, %zi KiB/s",
+	       status.bytes / 1024, status.total / 1024, (ssize_t)(status.rate / 1024));
+	fflush(stdout);
+}
+
+/** Updates the download progress, printing it at most once per STATUS_INTERVAL */
+void status_progress(ssize_t bytes, ssize_t total) {
+	status.bytes = bytes;
+	status.total = total;
+
+	double now = get_time();
+	if (now - status.sample_time < STATUS_INTERVAL)
+		return;
+
+	status.rate = (bytes - status.sample_bytes) / (now - status.sample_time);
+	status.sample_time = now;
+	status.sample_bytes = bytes;
+	print_progress();
+}
+
+/** Prints the final progress of a download */
+void status_progress_done(void) {
+	print_progress();
+	puts("");
+}
+
+/** Returns to the idle state after a check */
+void status_finish(bool updated, const char *result) {
+	status.state = STATUS_IDLE;
+	status.last_check = time(NULL);
+	status.last_updated = updated;
+	status.last_result = result;
+}
+
+
+int status_ubus_method(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req, const char *method, struct blob_attr *msg) {
+	struct blob_buf b = {};
+	blob_buf_init(&b, 0);
+
+	blobmsg_add_string(&b, "state", state_names[status.state]);
+
+	if (status.source) {
+		blobmsg_add_string(&b, "source", status.source);
+		blobmsg_add_string(&b, "source_type", status.mirror ? "mirror" : "neighbour");
+		blobmsg_add_u64(&b, "bytes", status.bytes);
+		if (status.total >= 0)
+			blobmsg_add_u64(&b, "total", status.total);
+		blobmsg_add_u64(&b, "rate", status.rate);
+	}
+
+	if (status.last_check) {
+		blobmsg_add_u64(&b, "last_check", status.last_check);
+		blobmsg_add_u8(&b, "last_updated", status.last_updated);
+		if (status.last_result)
+			blobmsg_add_string(&b, "last_result", status.last_result);
+	}
+
+	ubus_send_reply(ctx, req, b.head);
+	blob_buf_free(&b);
+
+	return UBUS_STATUS_OK;
+}
+
+
+static const struct ubus_method status_methods[] = {
+	UBUS_METHOD_NOARG("status", status_ubus_method),
+};
+
+static struct ubus_object_type status_object_type = UBUS_OBJECT_TYPE("autoupdater", status_methods);
+
+static struct ubus_object status_object = {
+	.name = "autoupdater",
+	.type = &status_object_type,
+	.methods = status_methods,
+	.n_methods = ARRAY_SIZE(status_methods),
+};
+
+static struct ubus_context *status_ubus;
+
+
+/** Publishes the status for a single run, unless a daemon already does */
+void status_publish(void) {
+	status_ubus = ubus_connect(NULL);
+	if (!status_ubus)
+		return;
+
+	ubus_add_uloop(status_ubus);
+	if (ubus_add_object(status_ubus, &status_object))
+		status_unpublish();
+}
+
+void status_unpublish(void) {
+	if (!status_ubus)
+		return;
+
+	ubus_free(status_ubus);
+	status_ubus = NULL;
+}
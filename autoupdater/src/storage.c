@@ -0,0 +1,140 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "storage.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/statvfs.h>
+
+
+/* Memory that has to stay available for the rest of the system while the image sits in tmpfs */
+#define MEM_RESERVE (4 * 1024 * 1024)
+
+static const char *const image_file = "firmware.bin";
+
+
+/** Returns the memory available for new allocations in bytes or -1 on error */
+static int64_t get_mem_available(const char *meminfo_path) {
+	FILE *f = fopen(meminfo_path, "r");
+	if (!f)
+		return -1;
+
+	char line[128];
+	unsigned long long val;
+	int64_t mem_free = -1, mem_cached = -1, mem_available = -1;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "MemAvailable: %llu kB", &val) == 1)
+			mem_available = val * 1024;
+		else if (sscanf(line, "MemFree: %llu kB", &val) == 1)
+			mem_free = val * 1024;
+		else if (sscanf(line, "Cached: %llu kB", &val) == 1)
+			mem_cached = val * 1024;
+	}
+
+	fclose(f);
+
+	if (mem_available >= 0)
+		return mem_available;
+
+	/* Kernels before 3.14 don't provide MemAvailable */
+	if (mem_free >= 0 && mem_cached >= 0)
+		return mem_free + mem_cached;
+
+	return -1;
+}
+
+
+/** Returns the space available to unprivileged users on the filesystem containing path or -1 on error */
+static int64_t get_fs_available(const char *path) {
+	struct statvfs st;
+	if (statvfs(path, &st))
+		return -1;
+
+	return (int64_t)st.f_bavail * st.f_frsize;
+}
+
+
+const struct storage_env default_storage_env = {
+	.meminfo_path = "/proc/meminfo",
+	.tmp_dir = "/tmp",
+	.fs_available = get_fs_available,
+};
+
+
+static bool set_plan(struct download_plan *plan, enum download_target target, const char *dir) {
+	if (snprintf(plan->path, sizeof(plan->path), "%s/%s", dir, image_file) >= sizeof(plan->path))
+		return false;
+
+	plan->target = target;
+	return true;
+}
+
+
+/**
+ * Decides where an image of the given size can be stored without exhausting
+ * the memory of the node. The image is staged in tmpfs if both the tmpfs and
+ * the available memory have enough headroom; otherwise the first configured
+ * storage directory with enough free space is used.
+ */
+bool plan_download(struct download_plan *plan, const struct storage_env *env, ssize_t imagesize, const char **storage, size_t n_storage) {
+	plan->target = DOWNLOAD_TARGET_NONE;
+	plan->path[0] = '\0';
+
+	int64_t mem_available = get_mem_available(env->meminfo_path);
+	int64_t tmp_available = env->fs_available(env->tmp_dir);
+
+	if (mem_available < 0 || tmp_available < 0) {
+		fputs("autoupdater: warning: unable to determine available memory, assuming image fits into tmpfs\n", stderr);
+		return set_plan(plan, DOWNLOAD_TARGET_TMPFS, env->tmp_dir);
+	}
+
+	if (imagesize <= tmp_available && imagesize + MEM_RESERVE <= mem_available)
+		return set_plan(plan, DOWNLOAD_TARGET_TMPFS, env->tmp_dir);
+
+	fprintf(stderr,
+		"autoupdater: info: image of %zi KiB doesn't fit into memory (%lli KiB available, %lli KiB free in %s)\n",
+		imagesize / 1024, (long long)(mem_available / 1024), (long long)(tmp_available / 1024), env->tmp_dir);
+
+	for (size_t i = 0; i < n_storage; i++) {
+		int64_t available = env->fs_available(storage[i]);
+		if (available < 0) {
+			fprintf(stderr, "autoupdater: warning: unable to access image storage %s\n", storage[i]);
+			continue;
+		}
+
+		if (imagesize > available)
+			continue;
+
+		if (set_plan(plan, DOWNLOAD_TARGET_STORAGE, storage[i]))
+			return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,261 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "trace.h"
+#include "statefile.h"
+#include "util.h"
+
+#include <footprint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/resource.h>
+
+
+/*
+ * Every run is traced as one line of JSON, which is appended to a ring of
+ * TRACE_SIZE lines in trace_path and sent to syslog. Phases that didn't
+ * happen are left out. CPU times include the hooks and other children.
+ * Mesh neighbour discovery overlaps with the manifest requests, so its CPU
+ * time includes theirs; its wall time is the discovery latency.
+ *
+ * uclient resolves names synchronously when connecting, so the DNS time of
+ * a request is the time spent in uclient_connect(). TCP and TLS handshakes
+ * happen in the background and are part of the time to first byte.
+ *
+ * Memory is given in KiB. The peak RSS is reset at the start of every run
+ * where the kernel allows it. The kernel keeps no peak of the heap, so none
+ * is reported; the heap is part of the peak RSS.
+ */
+static const char *const trace_path = "/tmp/autoupdater.trace";
+
+#define TRACE_SIZE 100
+
+
+static const char *const phase_names[__TRACE_MAX] = {
+	[TRACE_CONFIG] = "config",
+	[TRACE_DISCOVERY] = "discovery",
+	[TRACE_MANIFEST] = "manifest",
+	[TRACE_VERIFY] = "verify",
+	[TRACE_IMAGE] = "image",
+	[TRACE_HASH] = "hash",
+	[TRACE_HOOKS] = "hooks",
+};
+
+static const char *const request_names[__TRACE_REQUEST_MAX] = {
+	[TRACE_REQUEST_MANIFEST] = "manifest_request",
+	[TRACE_REQUEST_IMAGE] = "image_request",
+};
+
+struct traced_request {
+	char *source;
+	bool reused;
+	double dns;
+	double ttfb;
+	double transfer;
+	ssize_t bytes;
+	double throughput;
+};
+
+static struct {
+	bool active;
+	time_t time;
+	struct trace_span start;
+	bool traced[__TRACE_MAX];
+	double wall[__TRACE_MAX];
+	double cpu[__TRACE_MAX];
+	struct traced_request requests[__TRACE_REQUEST_MAX];
+	const char *result;
+} trace;
+
+/* 0 if unlimited */
+static unsigned long rss_budget, cpu_budget;
+
+
+static double cpu_time(void) {
+	struct rusage self, children;
+	getrusage(RUSAGE_SELF, &self);
+	getrusage(RUSAGE_CHILDREN, &children);
+
+	return self.ru_utime.tv_sec + self.ru_stime.tv_sec + children.ru_utime.tv_sec + children.ru_stime.tv_sec
+		+ (self.ru_utime.tv_usec + self.ru_stime.tv_usec + children.ru_utime.tv_usec + children.ru_stime.tv_usec) / 1e6;
+}
+
+/** Lets the kernel start over with the peak RSS, supported since Linux 4.0 */
+static void reset_rss_peak(void) {
+	FILE *f = fopen("/proc/self/clear_refs", "w");
+	if (!f)
+		return;
+
+	fputs("5", f);
+	fclose(f);
+}
+
+/** Sets the peak RSS in KiB and the CPU time in ms a run may take without a warning, 0 for no limit */
+void trace_set_budget(unsigned long rss_kib, unsigned long cpu_ms) {
+	rss_budget = rss_kib;
+	cpu_budget = cpu_ms;
+}
+
+/** Starts tracing a run. Phases traced before, like loading the configuration, become part of it */
+void trace_begin(void) {
+	reset_rss_peak();
+	trace.active = true;
+	trace.time = time(NULL);
+	trace_span_start(&trace.start);
+	trace.result = NULL;
+}
+
+void trace_span_start(struct trace_span *span) {
+	span->wall = get_time();
+	span->cpu = cpu_time();
+}
+
+/** Adds the time since trace_span_start() to a phase */
+void trace_span_stop(struct trace_span *span, enum trace_phase phase) {
+	trace.traced[phase] = true;
+	trace.wall[phase] += get_time() - span->wall;
+	trace.cpu[phase] += cpu_time() - span->cpu;
+}
+
+/** Records the timing of a finished request, replacing the one recorded before */
+void trace_request(enum trace_request kind, const char *source, const struct url_request *req) {
+	struct traced_request *r = &trace.requests[kind];
+	const struct uclient_data *d = &req->d;
+
+	free(r->source);
+	*r = (struct traced_request){
+		.source = strdup(source),
+		.reused = d->reused,
+		.dns = d->connect_time > 0 ? d->connect_time - d->start_time : -1,
+		.ttfb = d->header_time > 0 && d->connect_time > 0 ? d->header_time - d->connect_time : -1,
+		.transfer = d->header_time > 0 ? d->end_time - d->header_time : -1,
+		.bytes = d->downloaded,
+		.throughput = url_request_throughput(req),
+	};
+}
+
+/** Sets a short word describing the outcome of the run */
+void trace_result(const char *result) {
+	trace.result = result;
+}
+
+const char * trace_get_result(void) {
+	return trace.result;
+}
+
+
+static void write_string(FILE *f, const char *s) {
+	fputc('"', f);
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+static void write_seconds(FILE *f, const char *key, double seconds) {
+	if (seconds >= 0)
+		fprintf(f, ",\"%s\":%.3f", key, seconds);
+}
+
+/** Writes the trace of the current run and resets it */
+void trace_write(void) {
+	if (!trace.active)
+		return;
+
+	double cpu = cpu_time() - trace.start.cpu;
+	struct footprint fp;
+	footprint_read(&fp);
+
+	bool over_budget = false;
+	if (rss_budget && fp.rss_peak > rss_budget) {
+		fprintf(stderr, "autoupdater: warning: peak RSS of %lu KiB exceeds the budget of %lu KiB\n", fp.rss_peak, rss_budget);
+		over_budget = true;
+	}
+	if (cpu_budget && cpu * 1000 > cpu_budget) {
+		fprintf(stderr, "autoupdater: warning: CPU time of %.0f ms exceeds the budget of %lu ms\n", cpu * 1000, cpu_budget);
+		over_budget = true;
+	}
+
+	char *line = NULL;
+	size_t len;
+	FILE *f = open_memstream(&line, &len);
+	if (!f)
+		goto out;
+
+	fprintf(f, "{\"time\":%lld,\"result\":", (long long)trace.time);
+	write_string(f, trace.result ?: "unknown");
+	fprintf(f, ",\"wall\":%.3f,\"cpu\":%.3f", get_time() - trace.start.wall, cpu);
+	fprintf(f, ",\"memory\":{\"rss_peak\":%lu,\"vm_peak\":%lu}", fp.rss_peak, fp.vm_peak);
+	if (over_budget)
+		fputs(",\"over_budget\":true", f);
+
+	for (size_t i = 0; i < __TRACE_MAX; i++) {
+		if (trace.traced[i])
+			fprintf(f, ",\"%s\":{\"wall\":%.3f,\"cpu\":%.3f}", phase_names[i], trace.wall[i], trace.cpu[i]);
+	}
+
+	for (size_t i = 0; i < __TRACE_REQUEST_MAX; i++) {
+		const struct traced_request *r = &trace.requests[i];
+		if (!r->source)
+			continue;
+
+		fprintf(f, ",\"%s\":{\"source\":", request_names[i]);
+		write_string(f, r->source);
+		fprintf(f, ",\"reused\":%s", r->reused ? "true" : "false");
+		write_seconds(f, "dns", r->dns);
+		write_seconds(f, "ttfb", r->ttfb);
+		write_seconds(f, "transfer", r->transfer);
+		fprintf(f, ",\"bytes\":%zd,\"throughput\":%.0f}", r->bytes, r->throughput);
+	}
+
+	fputc('}', f);
+	if (fclose(f))
+		goto out;
+
+	if (!statefile_append(trace_path, line, TRACE_SIZE))
+		fprintf(stderr, "autoupdater: warning: unable to store trace: %m\n");
+
+	openlog("autoupdater", 0, LOG_DAEMON);
+	syslog(LOG_INFO, "trace: %s", line);
+	closelog();
+
+out:
+	free(line);
+	for (size_t i = 0; i < __TRACE_REQUEST_MAX; i++)
+		free(trace.requests[i].source);
+	memset(&trace, 0, sizeof(trace));
+}
@@ -0,0 +1,64 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+
+#include "uclient.h"
+
+
+/* Phases of a run whose wall and CPU time are traced */
+enum trace_phase {
+	TRACE_CONFIG,
+	TRACE_DISCOVERY,
+	TRACE_MANIFEST,
+	TRACE_VERIFY,
+	TRACE_IMAGE,
+	TRACE_HASH,
+	TRACE_HOOKS,
+	__TRACE_MAX,
+};
+
+/* The requests of a run whose timing is traced */
+enum trace_request {
+	TRACE_REQUEST_MANIFEST,
+	TRACE_REQUEST_IMAGE,
+	__TRACE_REQUEST_MAX,
+};
+
+/* Wall and CPU time at the start of a phase */
+struct trace_span {
+	double wall;
+	double cpu;
+};
+
+
+void trace_set_budget(unsigned long rss_kib, unsigned long cpu_ms);
+void trace_begin(void);
+void trace_span_start(struct trace_span *span);
+void trace_span_stop(struct trace_span *span, enum trace_phase phase);
+void trace_request(enum trace_request kind, const char *source, const struct url_request *req);
+void trace_result(const char *result);
+const char * trace_get_result(void);
+void trace_write(void);
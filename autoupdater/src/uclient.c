@@ -25,23 +25,38 @@
 
 
 #include "uclient.h"
+#include "util.h"
 
 #include <libubox/blobmsg.h>
+#include <libubox/list.h>
 #include <libubox/uloop.h>
+#include <libubox/ustream-ssl.h>
+#include <libubox/utils.h>
 
+#include <dlfcn.h>
+#include <glob.h>
 #include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
 
 
 #define TIMEOUT_MSEC 300000
+/* Idle connections kept for reuse, see url_pool_put() */
+#define POOL_SIZE 4
 
 static const char *const user_agent = "Gluon Autoupdater (using libuclient)";
+static const char *const ssl_library = "libustream-ssl.so";
+static const char *const ca_certificates = "/etc/ssl/certs/*.crt";
 
 enum uclient_own_error_code {
 	UCLIENT_ERROR_REDIRECT_FAILED = 32,
 	UCLIENT_ERROR_TOO_MANY_REDIRECTS,
 	UCLIENT_ERROR_CONNECTION_RESET_PREMATURELY,
 	UCLIENT_ERROR_SIZE_MISMATCH,
+	UCLIENT_ERROR_CANCELLED,
 	UCLIENT_ERROR_STATUS_CODE = 1024,
 };
 
@@ -58,6 +73,12 @@ const char *uclient_get_errmsg(int code) {
 		return "Connection failed";
 	case UCLIENT_ERROR_TIMEDOUT:
 		return "Connection timed out";
+	case UCLIENT_ERROR_SSL_INVALID_CERT:
+		return "Invalid SSL certificate";
+	case UCLIENT_ERROR_SSL_CN_MISMATCH:
+		return "SSL certificate does not match host name";
+	case UCLIENT_ERROR_MISSING_SSL_CONTEXT:
+		return "HTTPS is not supported (libustream-ssl missing)";
 	case UCLIENT_ERROR_REDIRECT_FAILED:
 		return "Failed to redirect";
 	case UCLIENT_ERROR_TOO_MANY_REDIRECTS:
@@ -66,16 +87,372 @@ const char *uclient_get_errmsg(int code) {
 		return "Connection reset prematurely";
 	case UCLIENT_ERROR_SIZE_MISMATCH:
 		return "Incorrect file size";
+	case UCLIENT_ERROR_CANCELLED:
+		return "Cancelled";
 	default:
 		return "Unknown error";
 	}
 }
 
 
+/** Returns true if the server doesn't have the requested resource */
+bool uclient_not_found(int code) {
+	return code == (UCLIENT_ERROR_STATUS_CODE | 404) || code == (UCLIENT_ERROR_STATUS_CODE | 410);
+}
+
+
+/** Returns true if the server turned a request down because it is overloaded */
+bool uclient_overloaded(int code) {
+	return code == (UCLIENT_ERROR_STATUS_CODE | 429) || code == (UCLIENT_ERROR_STATUS_CODE | 503);
+}
+
+
+/*
+ * HTTPS is supported if libustream-ssl is installed. It is loaded when the
+ * first client is created, as any request may be redirected to HTTPS. All
+ * requests share a single SSL context, which lives as long as the process,
+ * so the CA certificates are only loaded once.
+ */
+static const struct ustream_ssl_ops *ssl_ops;
+static struct ustream_ssl_ctx *ssl_ctx;
+static bool ssl_tried;
+
+
+/** Loads libustream-ssl and sets up the SSL context on first use */
+static bool ssl_init(void) {
+	if (ssl_tried)
+		return ssl_ctx;
+	ssl_tried = true;
+
+	/* Not an error on nodes without HTTPS mirrors, https:// requests fail with their own message */
+	void *dlh = dlopen(ssl_library, RTLD_LAZY|RTLD_LOCAL);
+	if (!dlh)
+		return false;
+
+	ssl_ops = dlsym(dlh, "ustream_ssl_ops");
+	if (!ssl_ops) {
+		fprintf(stderr, "autoupdater: warning: %s is missing its interface, HTTPS is not available\n", ssl_library);
+		dlclose(dlh);
+		return false;
+	}
+
+	ssl_ctx = ssl_ops->context_new(false);
+	if (!ssl_ctx) {
+		fputs("autoupdater: warning: unable to create SSL context, HTTPS is not available\n", stderr);
+		ssl_ops = NULL;
+		dlclose(dlh);
+		return false;
+	}
+
+	glob_t gl;
+	if (!glob(ca_certificates, 0, NULL, &gl)) {
+		for (size_t i = 0; i < gl.gl_pathc; i++)
+			ssl_ops->context_add_ca_crt_file(ssl_ctx, gl.gl_pathv[i]);
+		globfree(&gl);
+	}
+
+	return true;
+}
+
+
+/*
+ * Clients of finished requests keep their connection open in a small pool,
+ * keyed by the origin (scheme, host and port) of the URL they requested.
+ * The next request to the same server picks the client up again and sends
+ * its request over the open connection, so the image is fetched over the
+ * connection of the manifest, and the range requests for the blocks of a
+ * binary manifest share one connection. uclient_set_url() would drop the
+ * connection, so the client is pointed at the new URL by url_retarget()
+ * instead.
+ *
+ * Pooled clients have no uclient_data; their callbacks only drop the
+ * connection if the server closes it or it times out, and such a client
+ * is discarded instead of being reused.
+ */
+struct pooled_client {
+	struct uclient *cl;
+	char *origin;
+	bool closed;
+};
+
+static struct pooled_client pool[POOL_SIZE];
+static size_t pool_len;
+
+
+/** Returns the length of the scheme://authority part of a URL, split the way libuclient does it */
+static size_t url_origin_len(const char *url) {
+	const char *host = strstr(url, "://");
+	if (!host)
+		return 0;
+
+	host += 3;
+	return host - url + strcspn(host, "/");
+}
+
+
+/** Returns true if two URLs lead to the same server */
+static bool url_same_origin(const char *a, const char *b) {
+	size_t len = url_origin_len(a);
+	return len && len == url_origin_len(b) && !strncmp(a, b, len);
+}
+
+
+/** Points a client at another URL on the same server without dropping its connection */
+static int url_retarget(struct uclient *cl, const char *url) {
+	const struct uclient_url *old = cl->url;
+	const char *location = url + url_origin_len(url);
+	char *host_buf, *port_buf, *location_buf, *auth_buf;
+
+	if (!*location)
+		location = "/";
+
+	struct uclient_url *next = calloc_a(sizeof(*next),
+		&host_buf, strlen(old->host) + 1,
+		&port_buf, old->port ? strlen(old->port) + 1 : 0,
+		&location_buf, strlen(location) + 1,
+		&auth_buf, old->auth ? strlen(old->auth) + 1 : 0);
+	if (!next)
+		return -1;
+
+	*next = (struct uclient_url){
+		.backend = old->backend,
+		.prefix = old->prefix,
+		.host = strcpy(host_buf, old->host),
+		.port = old->port ? strcpy(port_buf, old->port) : NULL,
+		.location = strcpy(location_buf, location),
+		.auth = old->auth ? strcpy(auth_buf, old->auth) : NULL,
+	};
+
+	/* libuclient allocates its URLs the same way and releases them with free() */
+	free(cl->url);
+	cl->url = next;
+
+	return 0;
+}
+
+
+static void url_pool_remove(size_t i) {
+	free(pool[i].origin);
+	memmove(&pool[i], &pool[i+1], (pool_len - i - 1) * sizeof(*pool));
+	pool_len--;
+}
+
+
+/** Takes an idle client connected to the server of url from the pool */
+static struct uclient * url_pool_take(const char *url) {
+	size_t len = url_origin_len(url);
+
+	for (size_t i = 0; i < pool_len; ) {
+		struct uclient *cl = pool[i].cl;
+
+		if (pool[i].closed) {
+			uclient_free(cl);
+			url_pool_remove(i);
+			continue;
+		}
+
+		if (len && strlen(pool[i].origin) == len && !strncmp(pool[i].origin, url, len)) {
+			url_pool_remove(i);
+			return cl;
+		}
+
+		i++;
+	}
+
+	return NULL;
+}
+
+
+/** Puts the client of a finished request into the pool, evicting the oldest one if it is full */
+static void url_pool_put(struct uclient *cl, const char *url) {
+	char *origin = strndup(url, url_origin_len(url));
+	if (!origin) {
+		uclient_free(cl);
+		return;
+	}
+
+	if (pool_len == POOL_SIZE) {
+		uclient_free(pool[0].cl);
+		url_pool_remove(0);
+	}
+
+	cl->priv = NULL;
+	pool[pool_len++] = (struct pooled_client){
+		.cl = cl,
+		.origin = origin,
+	};
+}
+
+
+/** Marks a pooled client whose connection went away, it is freed outside of its callbacks */
+static void url_pool_closed(struct uclient *cl) {
+	for (size_t i = 0; i < pool_len; i++) {
+		if (pool[i].cl == cl)
+			pool[i].closed = true;
+	}
+}
+
+
+/** Closes all idle connections */
+void url_pool_flush(void) {
+	for (size_t i = 0; i < pool_len; i++) {
+		uclient_free(pool[i].cl);
+		free(pool[i].origin);
+	}
+	pool_len = 0;
+}
+
+
+/** Returns true if the connection of a finished request may carry another request */
+static bool keep_alive(struct uclient *cl) {
+	const struct blobmsg_policy policy = {
+		.name = "connection",
+		.type = BLOBMSG_TYPE_STRING,
+	};
+	struct blob_attr *tb;
+
+	/* Only a response that has been read completely leaves the connection usable */
+	if (!cl->data_eof)
+		return false;
+
+	blobmsg_parse(&policy, 1, &tb, blob_data(cl->meta), blob_len(cl->meta));
+	return !tb || strcasecmp(blobmsg_get_string(tb), "close");
+}
+
+
 static void request_done(struct uclient *cl, int err_code) {
-	uclient_data(cl)->err_code = err_code;
-	uclient_disconnect(cl);
-	uloop_end();
+	struct uclient_data *d = uclient_data(cl);
+	if (!d) {
+		/* A pooled connection went away */
+		url_pool_closed(cl);
+		uclient_disconnect(cl);
+		return;
+	}
+	if (d->done)
+		return;
+
+	if (!err_code && !d->not_modified && d->length >= 0 && d->downloaded != d->length)
+		err_code = UCLIENT_ERROR_SIZE_MISMATCH;
+
+	d->err_code = err_code;
+	d->done = true;
+	d->end_time = get_time();
+
+	if (err_code || !keep_alive(cl))
+		uclient_disconnect(cl);
+
+	struct url_request *req = container_of(d, struct url_request, d);
+	if (req->done_cb)
+		req->done_cb(req);
+}
+
+
+void http_validators_clear(struct http_validators *validators) {
+	free(validators->etag);
+	free(validators->last_modified);
+	validators->etag = NULL;
+	validators->last_modified = NULL;
+}
+
+
+/** Replaces the validators with the ones the server sent along with the resource */
+static void store_validators(struct uclient *cl, struct http_validators *validators) {
+	enum {
+		VALIDATOR_ETAG,
+		VALIDATOR_LAST_MODIFIED,
+		__VALIDATOR_MAX,
+	};
+	const struct blobmsg_policy policy[__VALIDATOR_MAX] = {
+		[VALIDATOR_ETAG] = { .name = "etag", .type = BLOBMSG_TYPE_STRING },
+		[VALIDATOR_LAST_MODIFIED] = { .name = "last-modified", .type = BLOBMSG_TYPE_STRING },
+	};
+	struct blob_attr *tb[__VALIDATOR_MAX];
+
+	http_validators_clear(validators);
+
+	blobmsg_parse(policy, __VALIDATOR_MAX, tb, blob_data(cl->meta), blob_len(cl->meta));
+	if (tb[VALIDATOR_ETAG])
+		validators->etag = strdup(blobmsg_get_string(tb[VALIDATOR_ETAG]));
+	if (tb[VALIDATOR_LAST_MODIFIED])
+		validators->last_modified = strdup(blobmsg_get_string(tb[VALIDATOR_LAST_MODIFIED]));
+}
+
+
+/** Parses a Retry-After header, which is either a number of seconds or an HTTP date */
+static unsigned long parse_retry_after(struct uclient *cl) {
+	const struct blobmsg_policy policy = {
+		.name = "retry-after",
+		.type = BLOBMSG_TYPE_STRING,
+	};
+	struct blob_attr *tb;
+
+	blobmsg_parse(&policy, 1, &tb, blob_data(cl->meta), blob_len(cl->meta));
+	if (!tb)
+		return 0;
+
+	const char *value = blobmsg_get_string(tb);
+	char *end;
+
+	errno = 0;
+	unsigned long seconds = strtoul(value, &end, 10);
+	if (!errno && end != value && !*end)
+		return seconds;
+
+	struct tm tm = {};
+	end = strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+	if (!end || *end)
+		return 0;
+
+	time_t date = timegm(&tm), now = time(NULL);
+	return date > now ? date - now : 0;
+}
+
+
+/** Resolves the Location header of a redirect against the URL it answers, returns NULL if there is none */
+static char * redirect_location(struct uclient *cl, const char *url) {
+	const struct blobmsg_policy policy = {
+		.name = "location",
+		.type = BLOBMSG_TYPE_STRING,
+	};
+	struct blob_attr *tb;
+	char *ret;
+
+	blobmsg_parse(&policy, 1, &tb, blob_data(cl->meta), blob_len(cl->meta));
+	if (!tb)
+		return NULL;
+
+	const char *location = blobmsg_get_string(tb);
+	size_t scheme = strspn(location, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+-.");
+	if (scheme && !strncmp(location + scheme, "://", 3))
+		return strdup(location);
+
+	size_t origin = url_origin_len(url);
+	if (!origin)
+		return NULL;
+
+	int base;
+	if (!strncmp(location, "//", 2)) {
+		/* Keep the scheme and its colon */
+		base = strstr(url, "://") - url + 1;
+	} else if (location[0] == '/') {
+		base = origin;
+	} else {
+		/* Relative to the directory of the current location, ignoring its query */
+		base = origin;
+		for (size_t i = origin; url[i] && url[i] != '?' && url[i] != '#'; i++) {
+			if (url[i] == '/')
+				base = i + 1;
+		}
+		if (base == origin) {
+			if (asprintf(&ret, "%.*s/%s", base, url, location) < 0)
+				return NULL;
+			return ret;
+		}
+	}
+
+	if (asprintf(&ret, "%.*s%s", base, url, location) < 0)
+		return NULL;
+	return ret;
 }
 
 
@@ -86,25 +463,58 @@ static void header_done_cb(struct uclient *cl) {
 	};
 	struct blob_attr *tb_len;
 
-	if (uclient_data(cl)->retries < 10) {
-		int ret = uclient_http_redirect(cl);
-		if (ret < 0) {
-			request_done(cl, UCLIENT_ERROR_REDIRECT_FAILED);
-			return;
-		}
-		if (ret > 0) {
-			uclient_data(cl)->retries++;
-			return;
-		}
+	if (!uclient_data(cl)) {
+		uclient_disconnect(cl);
+		return;
 	}
 
+	uclient_data(cl)->header_time = get_time();
+
 	switch (cl->status_code) {
 	case 200:
+		if (uclient_data(cl)->validators)
+			store_validators(cl, uclient_data(cl)->validators);
 		break;
+	case 206:
+		/* Only expected as the answer to a range request */
+		if (!uclient_data(cl)->range) {
+			request_done(cl, UCLIENT_ERROR_STATUS_CODE | cl->status_code);
+			return;
+		}
+		break;
+	case 304:
+		/* Only expected as the answer to a conditional request */
+		if (uclient_data(cl)->conditional) {
+			uclient_data(cl)->not_modified = true;
+			request_done(cl, 0);
+			return;
+		}
+		request_done(cl, UCLIENT_ERROR_STATUS_CODE | cl->status_code);
+		return;
+	case 429:
+	case 503:
+		/* The server is overloaded and may tell us when to come back */
+		uclient_data(cl)->retry_after = parse_retry_after(cl);
+		request_done(cl, UCLIENT_ERROR_STATUS_CODE | cl->status_code);
+		return;
 	case 301:
 	case 302:
+	case 303:
 	case 307:
-		request_done(cl, UCLIENT_ERROR_TOO_MANY_REDIRECTS);
+	case 308:
+		/*
+		 * Redirects are followed by redirect_cb() once the body has been
+		 * read, so that a redirect to the same server can keep the
+		 * connection. uclient_http_redirect() always reconnects.
+		 */
+		if (uclient_data(cl)->retries >= 10) {
+			request_done(cl, UCLIENT_ERROR_TOO_MANY_REDIRECTS);
+			return;
+		}
+
+		uclient_data(cl)->redirect = redirect_location(cl, container_of(uclient_data(cl), struct url_request, d)->url);
+		if (!uclient_data(cl)->redirect)
+			request_done(cl, UCLIENT_ERROR_REDIRECT_FAILED);
 		return;
 	default:
 		request_done(cl, UCLIENT_ERROR_STATUS_CODE | cl->status_code);
@@ -129,7 +539,32 @@ static void header_done_cb(struct uclient *cl) {
 }
 
 
+static void data_read_cb(struct uclient *cl) {
+	if (!uclient_data(cl)) {
+		uclient_disconnect(cl);
+		return;
+	}
+
+	if (uclient_data(cl)->redirect) {
+		/* The body of a redirect is of no interest, but must be read to keep the connection */
+		char buf[256];
+		while (uclient_read(cl, buf, sizeof(buf)) > 0) {}
+		return;
+	}
+
+	uclient_data(cl)->read_cb(cl);
+}
+
+
 static void eof_cb(struct uclient *cl) {
+	struct uclient_data *d = uclient_data(cl);
+
+	/* Not followed from here, as following may free the stream whose callback this is */
+	if (d && d->redirect && !d->done) {
+		uloop_timeout_set(&container_of(d, struct url_request, d)->redirect_timer, 0);
+		return;
+	}
+
 	request_done(cl, cl->data_eof ? 0 : UCLIENT_ERROR_CONNECTION_RESET_PREMATURELY);
 }
 
@@ -151,43 +586,192 @@ ssize_t uclient_read_account(struct uclient *cl, char *buf, int len) {
 }
 
 
-int get_url(const char *url, void (*read_cb)(struct uclient *cl), void *cb_data, ssize_t len) {
-	struct uclient_data d = { .custom = cb_data, .length = len };
-	struct uclient_cb cb = {
+/** Sends a request to the URL its client points at, over the open connection if there is one */
+static int url_request_send(struct url_request *req) {
+	struct http_validators *validators = req->d.validators;
+
+	if (uclient_set_timeout(req->cl, TIMEOUT_MSEC))
+		return -1;
+	/* Names are resolved synchronously here */
+	if (uclient_connect(req->cl))
+		return -1;
+	req->d.connect_time = get_time();
+	if (uclient_http_set_request_type(req->cl, "GET"))
+		return -1;
+	if (uclient_http_reset_headers(req->cl))
+		return -1;
+	if (uclient_http_set_header(req->cl, "User-Agent", user_agent))
+		return -1;
+	if (validators && validators->etag) {
+		if (uclient_http_set_header(req->cl, "If-None-Match", validators->etag))
+			return -1;
+		req->d.conditional = true;
+	}
+	if (validators && validators->last_modified) {
+		if (uclient_http_set_header(req->cl, "If-Modified-Since", validators->last_modified))
+			return -1;
+		req->d.conditional = true;
+	}
+	if (req->range && uclient_http_set_header(req->cl, "Range", req->range))
+		return -1;
+
+	return uclient_request(req->cl);
+}
+
+
+/** Follows the redirect of a request once its response has been read */
+static void redirect_cb(struct uloop_timeout *timeout) {
+	struct url_request *req = container_of(timeout, struct url_request, redirect_timer);
+	struct uclient *cl = req->cl;
+	char *url = req->d.redirect;
+	int ret;
+
+	if (req->d.done)
+		return;
+
+	req->d.redirect = NULL;
+	req->d.retries++;
+
+	if (url_same_origin(url, req->url) && keep_alive(cl)) {
+		ret = url_retarget(cl, url);
+	} else {
+		/* Drops the connection */
+		ret = uclient_set_url(cl, url, NULL);
+	}
+
+	free(req->url);
+	req->url = url;
+
+	if (ret || url_request_send(req))
+		request_done(cl, UCLIENT_ERROR_REDIRECT_FAILED);
+}
+
+
+/**
+ * Starts downloading a resource in the background. If validators are given,
+ * the server is asked to only send the resource if it doesn't match them
+ * anymore, and they are updated with the validators of the received resource.
+ * If the resource still matches, the request succeeds with req->d.not_modified
+ * set and without any data.
+ *
+ * req->done_cb and req->priv must be set by the caller, req->range may be set
+ * to request only part of the resource. Every started request must be released
+ * with url_request_finish(), which cancels it if it is still running.
+ */
+int url_request_start(struct url_request *req, const char *url, void (*read_cb)(struct uclient *cl), void *cb_data, ssize_t len, struct http_validators *validators) {
+	static const struct uclient_cb cb = {
 		.header_done = header_done_cb,
-		.data_read = read_cb,
+		.data_read = data_read_cb,
 		.data_eof = eof_cb,
 		.error = request_done,
 	};
 
-	struct uclient *cl = uclient_new(url, NULL, &cb);
-	if (!cl)
+	req->d = (struct uclient_data){
+		.custom = cb_data,
+		.read_cb = read_cb,
+		.length = len,
+		.validators = validators,
+		.range = req->range != NULL,
+		.start_time = get_time(),
+	};
+	req->redirect_timer = (struct uloop_timeout){
+		.cb = redirect_cb,
+	};
+	req->url = strdup(url);
+	if (!req->url)
 		goto err;
 
-	cl->priv = &d;
-	if (uclient_set_timeout(cl, TIMEOUT_MSEC))
-		goto err;
-	if (uclient_connect(cl))
-		goto err;
-	if (uclient_http_set_request_type(cl, "GET"))
-		goto err;
-	if (uclient_http_reset_headers(cl))
-		goto err;
-	if (uclient_http_set_header(cl, "User-Agent", user_agent))
-		goto err;
-	if (uclient_request(cl))
-		goto err;
-	uloop_run();
-	uclient_free(cl);
+	/* uclient_connect() keeps the connection of a pooled client */
+	req->cl = url_pool_take(url);
+	if (req->cl) {
+		req->d.reused = true;
+		if (url_retarget(req->cl, url))
+			goto err;
+	} else {
+		req->cl = uclient_new(url, NULL, &cb);
+		if (!req->cl)
+			goto err;
+
+		/* Plain HTTP requests may be redirected to HTTPS, so every client gets the context */
+		if (ssl_init() && uclient_http_set_ssl_ctx(req->cl, ssl_ops, ssl_ctx, true))
+			goto err;
+	}
+
+	req->cl->priv = &req->d;
 
-	if (!d.err_code && d.length >= 0 && d.downloaded != d.length)
-		return UCLIENT_ERROR_SIZE_MISMATCH;
+	if (url_request_send(req))
+		goto err;
 
-	return d.err_code;
+	return 0;
 
 err:
-	if (cl)
-		uclient_free(cl);
+	if (req->cl)
+		uclient_free(req->cl);
+	req->cl = NULL;
+	req->d.done = true;
+	req->d.err_code = UCLIENT_ERROR_CONNECT;
 
 	return UCLIENT_ERROR_CONNECT;
 }
+
+
+/** Releases a request, cancelling it if it hasn't finished yet, and returns its result */
+int url_request_finish(struct url_request *req) {
+	if (!req->d.done) {
+		req->d.done = true;
+		req->d.err_code = UCLIENT_ERROR_CANCELLED;
+		req->d.end_time = get_time();
+		uclient_disconnect(req->cl);
+	}
+	uloop_timeout_cancel(&req->redirect_timer);
+
+	/* After redirects, req->url is the URL the client was last pointed at */
+	if (req->cl && !req->d.err_code && keep_alive(req->cl))
+		url_pool_put(req->cl, req->url);
+	else if (req->cl)
+		uclient_free(req->cl);
+	req->cl = NULL;
+
+	free(req->url);
+	req->url = NULL;
+	free(req->d.redirect);
+	req->d.redirect = NULL;
+
+	return req->d.err_code;
+}
+
+
+/** Returns the transfer rate of a finished request in bytes per second, including the time to first byte */
+double url_request_throughput(const struct url_request *req) {
+	double elapsed = req->d.end_time - req->d.start_time;
+	if (elapsed <= 0)
+		return 0;
+
+	return req->d.downloaded / elapsed;
+}
+
+
+static void sync_done_cb(struct url_request *req) {
+	uloop_end();
+}
+
+
+/**
+ * Runs a request to completion, see url_request_start() for the meaning of
+ * validators. The request is released, but its data can still be inspected.
+ */
+int url_request_run(struct url_request *req, const char *url, void (*read_cb)(struct uclient *cl), void *cb_data, ssize_t len, struct http_validators *validators) {
+	req->done_cb = sync_done_cb;
+
+	if (!url_request_start(req, url, read_cb, cb_data, len, validators))
+		uloop_run();
+
+	return url_request_finish(req);
+}
+
+
+/** Downloads a resource, blocking until the request has finished */
+int get_url(const char *url, void (*read_cb)(struct uclient *cl), void *cb_data, ssize_t len) {
+	struct url_request req = { };
+	return url_request_run(&req, url, read_cb, cb_data, len, NULL);
+}
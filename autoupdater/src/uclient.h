@@ -26,17 +26,62 @@
 
 
 #include <libubox/uclient.h>
+
+#include <stdbool.h>
 #include <sys/types.h>
 
 
+/* cache validators of a resource, see RFC 7232 */
+struct http_validators {
+	char *etag;
+	char *last_modified;
+};
+
 struct uclient_data {
 	/* data that can be passed in by caller and used in custom callbacks */
 	void *custom;
+	void (*read_cb)(struct uclient *cl);
 	/* data used by uclient callbacks */
 	int retries;
 	int err_code;
+	bool done;
 	ssize_t downloaded;
 	ssize_t length;
+	struct http_validators *validators;
+	/* the request carried If-None-Match or If-Modified-Since */
+	bool conditional;
+	/* the server answered a conditional request with 304 Not Modified */
+	bool not_modified;
+	/* a byte range was requested, so 206 Partial Content is fine */
+	bool range;
+	/* seconds the server asked us to wait before retrying, 0 if it didn't */
+	unsigned long retry_after;
+	/* the request was sent over the open connection of an earlier request to the same server */
+	bool reused;
+	/* where a redirect leads, followed once its response has been read */
+	char *redirect;
+	/* monotonic timestamps of the request, its connection being set up, its response headers and its completion */
+	double start_time;
+	double connect_time;
+	double header_time;
+	double end_time;
+};
+
+/*
+ * A request running in the background of the uloop. done_cb is called
+ * from the uloop once the request has finished, successfully or not. It
+ * runs inside a uclient callback and must not release the request.
+ */
+struct url_request {
+	struct uclient *cl;
+	/* the requested URL, or where it redirected to */
+	char *url;
+	struct uclient_data d;
+	struct uloop_timeout redirect_timer;
+	void (*done_cb)(struct url_request *req);
+	void *priv;
+	/* optional value of a Range header, e.g. "bytes=0-4095" */
+	const char *range;
 };
 
 inline struct uclient_data * uclient_data(struct uclient *cl) {
@@ -50,5 +95,14 @@ inline void * uclient_get_custom(struct uclient *cl) {
 
 ssize_t uclient_read_account(struct uclient *cl, char *buf, int len);
 
+int url_request_start(struct url_request *req, const char *url, void (*read_cb)(struct uclient *cl), void *cb_data, ssize_t len, struct http_validators *validators);
+int url_request_finish(struct url_request *req);
+int url_request_run(struct url_request *req, const char *url, void (*read_cb)(struct uclient *cl), void *cb_data, ssize_t len, struct http_validators *validators);
+double url_request_throughput(const struct url_request *req);
+void url_pool_flush(void);
+
 int get_url(const char *url, void (*read_cb)(struct uclient *cl), void *cb_data, ssize_t len);
+void http_validators_clear(struct http_validators *validators);
 const char *uclient_get_errmsg(int code);
+bool uclient_overloaded(int code);
+bool uclient_not_found(int code);
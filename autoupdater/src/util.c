@@ -26,54 +26,12 @@
 
 #include "util.h"
 
-#include <fcntl.h>
-#include <glob.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 
-#include <sys/wait.h>
-
-
-void run_dir(const char *dir) {
-	char pat[strlen(dir) + 3];
-	sprintf(pat, "%s/*", dir);
-	glob_t globbuf;
-	if (glob(pat, 0, NULL, &globbuf))
-		return;
-
-	for (size_t i = 0; i < globbuf.gl_pathc; i++) {
-		char *path = globbuf.gl_pathv[i];
-		if (access(path, X_OK) < 0)
-			continue;
-
-		pid_t pid = fork();
-		if (pid < 0) {
-			fputs("autoupdater: warning: failed to fork: %m", stderr);
-			continue;
-		}
-
-		if (pid == 0) {
-			execl(path, path, (char *)NULL);
-			exit(EXIT_FAILURE);
-		}
-
-		int wstatus;
-		if (waitpid(pid, &wstatus, 0) != pid) {
-			fprintf(stderr, "autoupdater: warning: failed waiting for child %d corresponding to %s: ", pid, path);
-			perror(NULL);
-		} else if (!WIFEXITED(wstatus)) {
-			fprintf(stderr, "autoupdater: warning: execution of %s exited abnormally\n", path);
-		} else if (WEXITSTATUS(wstatus)) {
-			fprintf(stderr, "autoupdater: warning: execution of %s exited with status code %d\n", path, WEXITSTATUS(wstatus));
-		}
-	}
-
-	globfree(&globbuf);
-}
-
 
 void randomize(void) {
 	struct timespec tv;
@@ -101,6 +59,42 @@ float get_uptime(void) {
 	exit(1);
 }
 
+/**
+ * Returns a hash identifying this node, derived from its primary MAC
+ * address or, if that isn't known, from its hostname. Used to spread
+ * the load of many nodes over time without coordination.
+ */
+uint32_t get_node_hash(void) {
+	static const char *const primary_mac_path = "/lib/gluon/core/sysconfig/primary_mac";
+	char id[256] = "";
+
+	FILE *f = fopen(primary_mac_path, "r");
+	if (f) {
+		if (!fgets(id, sizeof(id), f))
+			id[0] = '\0';
+		fclose(f);
+	}
+
+	if (!id[0])
+		gethostname(id, sizeof(id) - 1);
+
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
+	for (const char *c = id; *c && *c != '\n'; c++) {
+		hash ^= (unsigned char)*c;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/** Returns the monotonic time in seconds */
+double get_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 void * safe_malloc(size_t size) {
 	void *ret = malloc(size);
 	if (!ret) {
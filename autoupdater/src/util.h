@@ -25,11 +25,13 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 
-void run_dir(const char *dir);
 void randomize(void);
 float get_uptime(void);
+double get_time(void);
+uint32_t get_node_hash(void);
 
 void * safe_malloc(size_t size);
 void * safe_realloc(void *ptr, size_t size);
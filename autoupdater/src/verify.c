@@ -0,0 +1,143 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "verify.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#define MAX_VERIFY_THREADS 4
+
+
+struct verify_job {
+	const ecc_int256_t *hash;
+	ecdsa_signature_t *const *signatures;
+	size_t n_signatures;
+	const ecc_25519_work_t *pubkeys;
+	size_t n_pubkeys;
+	size_t quorum;
+
+	/* Shared between the workers, only accessed atomically */
+	size_t next_signature;
+	size_t good_signatures;
+	bool *key_used;
+};
+
+
+static bool quorum_reached(struct verify_job *job) {
+	return __atomic_load_n(&job->good_signatures, __ATOMIC_ACQUIRE) >= job->quorum;
+}
+
+
+/**
+ * Takes signatures off the job until none are left or enough valid ones have
+ * been found. Every public key is only counted once, so pairs of a signature
+ * and an already matched key are skipped.
+ */
+static void * verify_worker(void *arg) {
+	struct verify_job *job = arg;
+
+	while (!quorum_reached(job)) {
+		size_t i = __atomic_fetch_add(&job->next_signature, 1, __ATOMIC_RELAXED);
+		if (i >= job->n_signatures)
+			break;
+
+		ecdsa_verify_context_t ctx;
+		ecdsa_verify_prepare_legacy(&ctx, job->hash, job->signatures[i]);
+
+		for (size_t j = 0; j < job->n_pubkeys; j++) {
+			if (quorum_reached(job))
+				break;
+
+			if (__atomic_load_n(&job->key_used[j], __ATOMIC_RELAXED))
+				continue;
+
+			if (!ecdsa_verify_legacy(&ctx, &job->pubkeys[j]))
+				continue;
+
+			/* Another worker might have matched the same key in the meantime */
+			bool expected = false;
+			if (!__atomic_compare_exchange_n(&job->key_used[j], &expected, true, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+				continue;
+
+			__atomic_fetch_add(&job->good_signatures, 1, __ATOMIC_RELEASE);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Counts the signatures made by distinct public keys, spreading the work over
+ * up to MAX_VERIFY_THREADS cores. Returns as soon as quorum valid signatures
+ * have been found, so the result is only exact if it's below quorum.
+ */
+size_t verify_signatures(const ecc_int256_t *hash, ecdsa_signature_t *const *signatures, size_t n_signatures,
+			 const ecc_25519_work_t *pubkeys, size_t n_pubkeys, size_t quorum) {
+	struct verify_job job = {
+		.hash = hash,
+		.signatures = signatures,
+		.n_signatures = n_signatures,
+		.pubkeys = pubkeys,
+		.n_pubkeys = n_pubkeys,
+		.quorum = quorum,
+		/* One extra element, so an empty key list doesn't look like an allocation failure */
+		.key_used = safe_malloc((n_pubkeys + 1) * sizeof(bool)),
+	};
+
+	memset(job.key_used, 0, n_pubkeys * sizeof(bool));
+
+	long n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n_threads > MAX_VERIFY_THREADS)
+		n_threads = MAX_VERIFY_THREADS;
+	if (n_threads > (long)n_signatures)
+		n_threads = n_signatures;
+
+	/* The calling thread is one of the workers */
+	pthread_t threads[MAX_VERIFY_THREADS];
+	long started = 0;
+	while (started < n_threads - 1) {
+		if (pthread_create(&threads[started], NULL, verify_worker, &job))
+			break;
+		started++;
+	}
+
+	verify_worker(&job);
+
+	for (long i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	free(job.key_used);
+
+	return job.good_signatures;
+}
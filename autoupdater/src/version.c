@@ -25,8 +25,10 @@
 
 
 #include "version.h"
+#include "util.h"
 
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 
 static int char_order(char c) {
@@ -92,3 +94,94 @@ bool newer_than(const char *a, const char *b) {
 
 	return false;
 }
+
+
+/* Numbers with more significant digits are compared digit by digit */
+#define VERSION_MAX_VALUE_DIGITS 19
+
+void version_key_init(struct version_key *key, const char *version) {
+	size_t len = strlen(version);
+	struct version_token *tokens = safe_malloc((len + 1) * sizeof(*tokens));
+	size_t n = 0;
+
+	while (*version) {
+		struct version_token *t = &tokens[n++];
+
+		if (!isdigit(*version)) {
+			*t = (struct version_token){ .order = char_order(*version) };
+			version++;
+			continue;
+		}
+
+		while (*version == '0')
+			version++;
+
+		*t = (struct version_token){ .order = 0, .digits = version };
+		while (isdigit(*version)) {
+			if (t->len < VERSION_MAX_VALUE_DIGITS)
+				t->value = 10 * t->value + (*version - '0');
+			t->len++;
+			version++;
+		}
+	}
+
+	key->tokens = safe_realloc(tokens, (n ?: 1) * sizeof(*tokens));
+	key->n_tokens = n;
+}
+
+void version_key_free(struct version_key *key) {
+	free(key->tokens);
+	key->tokens = NULL;
+	key->n_tokens = 0;
+}
+
+static int compare_numbers(const struct version_token *a, const struct version_token *b) {
+	unsigned alen = a ? a->len : 0, blen = b ? b->len : 0;
+
+	if (alen != blen)
+		return alen > blen ? 1 : -1;
+	if (!alen)
+		return 0;
+
+	if (alen <= VERSION_MAX_VALUE_DIGITS) {
+		if (a->value != b->value)
+			return a->value > b->value ? 1 : -1;
+		return 0;
+	}
+
+	int diff = memcmp(a->digits, b->digits, alen);
+	return (diff > 0) - (diff < 0);
+}
+
+/* Follows the comparison of newer_than() token by token */
+int version_key_compare(const struct version_key *a, const struct version_key *b) {
+	size_t i = 0, j = 0;
+
+	while (i < a->n_tokens || j < b->n_tokens) {
+		const struct version_token *ta = i < a->n_tokens ? &a->tokens[i] : NULL;
+		const struct version_token *tb = j < b->n_tokens ? &b->tokens[j] : NULL;
+
+		/* Non-digits compare by character order, numbers order as 0 and the end as -1 */
+		if ((ta && ta->order) || (tb && tb->order)) {
+			int oa = ta ? ta->order : -1, ob = tb ? tb->order : -1;
+			if (oa != ob)
+				return oa > ob ? 1 : -1;
+
+			i++;
+			j++;
+			continue;
+		}
+
+		/* Two numbers, or a number and the end */
+		int diff = compare_numbers(ta, tb);
+		if (diff)
+			return diff;
+
+		if (ta)
+			i++;
+		if (tb)
+			j++;
+	}
+
+	return 0;
+}
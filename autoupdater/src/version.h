@@ -26,5 +26,34 @@
 
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* A non-digit character or a number of a version string */
+struct version_token {
+	/* char_order() of a non-digit character, 0 for a number */
+	int order;
+	/* significant digits of a number */
+	unsigned len;
+	/* value of a number of at most 19 significant digits */
+	uint64_t value;
+	/* significant digits of a number, pointing into the parsed string */
+	const char *digits;
+};
+
+/* A version string parsed for repeated comparisons */
+struct version_key {
+	struct version_token *tokens;
+	size_t n_tokens;
+};
+
 
 bool newer_than(const char *a, const char *b);
+
+/** Parses a version string, which must outlive the key */
+void version_key_init(struct version_key *key, const char *version);
+void version_key_free(struct version_key *key);
+
+/** Orders two keys like newer_than() orders their strings, returning a positive value if a is newer */
+int version_key_compare(const struct version_key *a, const struct version_key *b);
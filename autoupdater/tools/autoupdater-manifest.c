@@ -0,0 +1,454 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/*
+ * Compiles a text manifest into the binary format described in
+ * binmanifest.h and handles its signatures. Runs on the build host:
+ *
+ *   autoupdater-manifest compile stable.manifest stable.manifest.bin
+ *   autoupdater-manifest header stable.manifest.bin > header
+ *   ecdsasign header < secret
+ *   autoupdater-manifest sign stable.manifest.bin <signature>
+ */
+
+
+#include "binmanifest.h"
+
+#include <hexutil.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+struct entry {
+	char *line;
+	size_t model_len;
+	uint32_t bucket;
+	uint32_t offset;
+	uint32_t length;
+};
+
+
+static void usage(void) {
+	fputs("\n"
+		"Usage: autoupdater-manifest compile <manifest> <binary manifest>\n"
+		"       autoupdater-manifest header <binary manifest>\n"
+		"       autoupdater-manifest sign <binary manifest> <signature>\n\n"
+		"compile turns a text manifest into a binary one without signatures,\n"
+		"header writes the part of a binary manifest to be signed to stdout and\n"
+		"sign adds a signature as made by ecdsasign.\n\n",
+		stderr
+	);
+}
+
+
+static void * xrealloc(void *ptr, size_t size) {
+	void *ret = realloc(ptr, size);
+	if (!ret) {
+		fputs("autoupdater-manifest: error: out of memory\n", stderr);
+		exit(1);
+	}
+
+	return ret;
+}
+
+
+static int compare_entries(const void *a, const void *b) {
+	const struct entry *ea = a, *eb = b;
+	size_t len = ea->model_len < eb->model_len ? ea->model_len : eb->model_len;
+
+	int ret = memcmp(ea->line, eb->line, len);
+	if (ret)
+		return ret;
+
+	return (ea->model_len > eb->model_len) - (ea->model_len < eb->model_len);
+}
+
+
+/** Checks that a model line has the five fields the autoupdater expects */
+static bool valid_model_line(const char *line) {
+	char *copy = strdup(line), *saveptr;
+	size_t n = 0;
+
+	for (char *tok = strtok_r(copy, " ", &saveptr); tok; tok = strtok_r(NULL, " ", &saveptr))
+		n++;
+
+	free(copy);
+	return n == 5;
+}
+
+
+static bool is_field(const char *line) {
+	size_t len = strspn(line, "ABCDEFGHIJKLMNOPQRSTUVWXYZ_");
+	return len && line[len] == '=';
+}
+
+
+static unsigned char * read_file(const char *path, size_t *len) {
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "autoupdater-manifest: error: unable to open %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+
+	unsigned char *buf = NULL;
+	size_t size = 0;
+	*len = 0;
+
+	while (true) {
+		if (*len == size) {
+			size = 2 * size + 4096;
+			buf = xrealloc(buf, size);
+		}
+
+		size_t r = fread(buf + *len, 1, size - *len, f);
+		if (!r)
+			break;
+		*len += r;
+	}
+
+	if (ferror(f)) {
+		fprintf(stderr, "autoupdater-manifest: error: unable to read %s\n", path);
+		exit(1);
+	}
+
+	fclose(f);
+	return buf;
+}
+
+
+static void write_file(const char *path, const unsigned char *buf, size_t len) {
+	char tmp_path[4096];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+	FILE *f = fopen(tmp_path, "w");
+	if (!f || fwrite(buf, 1, len, f) != len || fclose(f) || rename(tmp_path, path)) {
+		fprintf(stderr, "autoupdater-manifest: error: unable to write %s: %s\n", path, strerror(errno));
+		unlink(tmp_path);
+		exit(1);
+	}
+}
+
+
+/** Returns the offset and length of the signed header of a binary manifest */
+static size_t locate_header(const unsigned char *buf, size_t len, size_t *header_len) {
+	if (len < BINMANIFEST_PREAMBLE_SIZE || memcmp(buf, BINMANIFEST_MAGIC, 4))
+		goto invalid;
+
+	size_t offset = BINMANIFEST_PREAMBLE_SIZE + binmanifest_get16(buf + 4) * BINMANIFEST_SIGNATURE_SIZE;
+	if (len < offset + BINMANIFEST_HEADER_FIXED_SIZE)
+		goto invalid;
+
+	*header_len = binmanifest_get32(buf + offset);
+	if (*header_len < BINMANIFEST_HEADER_FIXED_SIZE || len - offset < *header_len)
+		goto invalid;
+
+	return offset;
+
+invalid:
+	fputs("autoupdater-manifest: error: not a binary manifest\n", stderr);
+	exit(1);
+}
+
+
+static int compile(const char *in_path, const char *out_path) {
+	FILE *in = fopen(in_path, "r");
+	if (!in) {
+		fprintf(stderr, "autoupdater-manifest: error: unable to open %s: %s\n", in_path, strerror(errno));
+		return 1;
+	}
+
+	char *fields = NULL;
+	size_t fields_len = 0;
+	struct entry *entries = NULL;
+	size_t n_entries = 0;
+
+	char *line = NULL;
+	size_t len = 0;
+
+	/* Signatures of the text manifest don't apply to the binary one */
+	while (getline(&line, &len, in) >= 0) {
+		line[strcspn(line, "\n")] = '\0';
+
+		if (!strcmp(line, "---"))
+			break;
+
+		if (!*line || *line == '#')
+			continue;
+
+		if (is_field(line)) {
+			size_t n = strlen(line);
+			fields = xrealloc(fields, fields_len + n + 1);
+			memcpy(fields + fields_len, line, n);
+			fields[fields_len + n] = '\n';
+			fields_len += n + 1;
+			continue;
+		}
+
+		/* The autoupdater skips lines it can't parse, so they are left out */
+		if (!valid_model_line(line) || strlen(line) > UINT16_MAX) {
+			fprintf(stderr, "autoupdater-manifest: warning: ignoring invalid line: %s\n", line);
+			continue;
+		}
+
+		entries = xrealloc(entries, (n_entries + 1) * sizeof(*entries));
+		entries[n_entries++] = (struct entry){
+			.line = strdup(line),
+			.model_len = strcspn(line, " "),
+		};
+	}
+
+	free(line);
+	fclose(in);
+
+	if (fields_len > UINT16_MAX || !n_entries) {
+		fputs("autoupdater-manifest: error: manifest lists no models or carries too many fields\n", stderr);
+		return 1;
+	}
+
+	/* The autoupdater takes the first line of a model, so do we */
+	size_t n = 0;
+	for (size_t i = 0; i < n_entries; i++) {
+		bool duplicate = false;
+		for (size_t j = 0; j < n && !duplicate; j++)
+			duplicate = !compare_entries(&entries[i], &entries[j]);
+
+		if (duplicate) {
+			fprintf(stderr, "autoupdater-manifest: warning: ignoring duplicate line: %s\n", entries[i].line);
+			free(entries[i].line);
+			continue;
+		}
+
+		entries[n++] = entries[i];
+	}
+	n_entries = n;
+
+	qsort(entries, n_entries, sizeof(*entries), compare_entries);
+
+	/* Merkle tree, level by level, starting with the leaves */
+	unsigned char **levels = NULL;
+	size_t *level_len = NULL, n_levels = 0;
+
+	for (size_t count = n_entries; ; count = count / 2 + count % 2) {
+		levels = xrealloc(levels, (n_levels + 1) * sizeof(*levels));
+		level_len = xrealloc(level_len, (n_levels + 1) * sizeof(*level_len));
+		levels[n_levels] = xrealloc(NULL, count * BINMANIFEST_HASH_SIZE);
+		level_len[n_levels] = count;
+
+		for (size_t i = 0; i < count; i++) {
+			unsigned char *out = levels[n_levels] + i * BINMANIFEST_HASH_SIZE;
+
+			if (!n_levels) {
+				binmanifest_leaf_hash(out, entries[i].line, strlen(entries[i].line));
+				continue;
+			}
+
+			const unsigned char *below = levels[n_levels - 1];
+			if (2*i + 1 < level_len[n_levels - 1])
+				binmanifest_node_hash(out, below + 2*i * BINMANIFEST_HASH_SIZE, below + (2*i + 1) * BINMANIFEST_HASH_SIZE);
+			else
+				memcpy(out, below + 2*i * BINMANIFEST_HASH_SIZE, BINMANIFEST_HASH_SIZE);
+		}
+
+		n_levels++;
+		if (count == 1)
+			break;
+	}
+
+	uint32_t n_buckets = (n_entries + BINMANIFEST_BUCKET_ENTRIES - 1) / BINMANIFEST_BUCKET_ENTRIES;
+	size_t header_len = BINMANIFEST_HEADER_FIXED_SIZE + fields_len + n_buckets * BINMANIFEST_BUCKET_SIZE;
+
+	/* Lay out the body: the index records first, then the entries */
+	size_t index_len = 0;
+	for (size_t i = 0; i < n_entries; i++) {
+		entries[i].bucket = binmanifest_bucket(entries[i].line, entries[i].model_len, n_buckets);
+		index_len += 2 + entries[i].model_len + 8;
+	}
+
+	size_t body_len = index_len;
+	for (size_t i = 0; i < n_entries; i++) {
+		size_t depth = 0;
+		for (size_t l = 0, index = i; l + 1 < n_levels; l++, index /= 2)
+			depth += (index ^ 1) < level_len[l];
+
+		entries[i].offset = body_len;
+		entries[i].length = 4 + 1 + depth * BINMANIFEST_HASH_SIZE + 2 + strlen(entries[i].line);
+		body_len += entries[i].length;
+	}
+
+	if (BINMANIFEST_PREAMBLE_SIZE + header_len + body_len > UINT32_MAX) {
+		fputs("autoupdater-manifest: error: manifest too large\n", stderr);
+		return 1;
+	}
+
+	size_t out_len = BINMANIFEST_PREAMBLE_SIZE + header_len + body_len;
+	unsigned char *out = xrealloc(NULL, out_len);
+	unsigned char *p = out;
+
+	memcpy(p, BINMANIFEST_MAGIC, 4);
+	binmanifest_put16(p + 4, 0);
+	binmanifest_put16(p + 6, 0);
+	p += BINMANIFEST_PREAMBLE_SIZE;
+
+	binmanifest_put32(p, header_len);
+	binmanifest_put32(p + 4, n_entries);
+	binmanifest_put32(p + 8, n_buckets);
+	memcpy(p + 12, levels[n_levels - 1], BINMANIFEST_HASH_SIZE);
+	binmanifest_put16(p + 44, fields_len);
+	memcpy(p + 46, fields, fields_len);
+	p += BINMANIFEST_HEADER_FIXED_SIZE + fields_len;
+
+	unsigned char *buckets = p;
+	p += n_buckets * BINMANIFEST_BUCKET_SIZE;
+
+	unsigned char *body = p;
+	for (uint32_t b = 0; b < n_buckets; b++) {
+		binmanifest_put32(buckets + b * BINMANIFEST_BUCKET_SIZE, p - body);
+
+		for (size_t i = 0; i < n_entries; i++) {
+			if (entries[i].bucket != b)
+				continue;
+
+			binmanifest_put16(p, entries[i].model_len);
+			memcpy(p + 2, entries[i].line, entries[i].model_len);
+			p += 2 + entries[i].model_len;
+			binmanifest_put32(p, entries[i].offset);
+			binmanifest_put32(p + 4, entries[i].length);
+			p += 8;
+		}
+
+		binmanifest_put32(buckets + b * BINMANIFEST_BUCKET_SIZE + 4, p - body - binmanifest_get32(buckets + b * BINMANIFEST_BUCKET_SIZE));
+	}
+
+	for (size_t i = 0; i < n_entries; i++) {
+		unsigned char *depth = p + 4;
+
+		binmanifest_put32(p, i);
+		*depth = 0;
+		p += 5;
+
+		for (size_t l = 0, index = i; l + 1 < n_levels; l++, index /= 2) {
+			if ((index ^ 1) >= level_len[l])
+				continue;
+
+			memcpy(p, levels[l] + (index ^ 1) * BINMANIFEST_HASH_SIZE, BINMANIFEST_HASH_SIZE);
+			p += BINMANIFEST_HASH_SIZE;
+			(*depth)++;
+		}
+
+		size_t line_len = strlen(entries[i].line);
+		binmanifest_put16(p, line_len);
+		memcpy(p + 2, entries[i].line, line_len);
+		p += 2 + line_len;
+	}
+
+	write_file(out_path, out, out_len);
+	printf("%zu models, %u buckets, %zu bytes\n", n_entries, n_buckets, out_len);
+
+	free(out);
+	for (size_t l = 0; l < n_levels; l++)
+		free(levels[l]);
+	free(levels);
+	free(level_len);
+	for (size_t i = 0; i < n_entries; i++)
+		free(entries[i].line);
+	free(entries);
+	free(fields);
+
+	return 0;
+}
+
+
+static int header(const char *path) {
+	size_t len, header_len;
+	unsigned char *buf = read_file(path, &len);
+	size_t offset = locate_header(buf, len, &header_len);
+
+	/* The magic is signed along with the header, see binmanifest.h */
+	if (fwrite(BINMANIFEST_MAGIC, 1, 4, stdout) != 4 ||
+	    fwrite(buf + offset, 1, header_len, stdout) != header_len) {
+		fputs("autoupdater-manifest: error: unable to write header\n", stderr);
+		return 1;
+	}
+
+	free(buf);
+	return 0;
+}
+
+
+static int sign(const char *path, const char *signature) {
+	unsigned char sig[BINMANIFEST_SIGNATURE_SIZE];
+	if (!parsehex(sig, signature, sizeof(sig))) {
+		fputs("autoupdater-manifest: error: invalid signature\n", stderr);
+		return 1;
+	}
+
+	size_t len, header_len;
+	unsigned char *buf = read_file(path, &len);
+	size_t offset = locate_header(buf, len, &header_len);
+
+	uint16_t n_signatures = binmanifest_get16(buf + 4);
+	for (uint16_t i = 0; i < n_signatures; i++) {
+		if (!memcmp(buf + BINMANIFEST_PREAMBLE_SIZE + i * BINMANIFEST_SIGNATURE_SIZE, sig, sizeof(sig))) {
+			fputs("autoupdater-manifest: info: signature already present\n", stderr);
+			free(buf);
+			return 0;
+		}
+	}
+
+	if (n_signatures == UINT16_MAX) {
+		fputs("autoupdater-manifest: error: too many signatures\n", stderr);
+		return 1;
+	}
+
+	unsigned char *out = xrealloc(NULL, len + sizeof(sig));
+	memcpy(out, buf, offset);
+	binmanifest_put16(out + 4, n_signatures + 1);
+	memcpy(out + offset, sig, sizeof(sig));
+	memcpy(out + offset + sizeof(sig), buf + offset, len - offset);
+
+	write_file(path, out, len + sizeof(sig));
+
+	free(out);
+	free(buf);
+	return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+	if (argc == 4 && !strcmp(argv[1], "compile"))
+		return compile(argv[2], argv[3]);
+	if (argc == 3 && !strcmp(argv[1], "header"))
+		return header(argv[2]);
+	if (argc == 4 && !strcmp(argv[1], "sign"))
+		return sign(argv[2], argv[3]);
+
+	usage();
+	return 1;
+}
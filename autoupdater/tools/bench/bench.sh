@@ -0,0 +1,126 @@
+#!/bin/sh
+#
+# End-to-end benchmark of the autoupdater and miau_proxy against a local
+# mirror behind an emulated network.
+#
+# Usage: bench.sh [-s <image size in KiB>] [-r <rounds>] [-b] [-m <KiB>] [-c <ms>] [<profile> ...]
+#
+#   -s  size of the generated image, 4096 KiB by default
+#   -r  runs per profile, 3 by default
+#   -b  use the binary manifest (needs autoupdater-manifest)
+#   -m  peak RSS budget of a run, no limit by default
+#   -c  CPU time budget of a run, no limit by default
+#
+# Profiles are lan, dsl, lte, mesh and lossy, see lib.sh; all of them are
+# run by default. The mirror and the node live in network namespaces
+# connected by a veth pair, shaped by netem in both directions.
+#
+# The autoupdater runs in -n mode, so the image is downloaded and checked
+# but not flashed. libplatforminfo has to know the model, so this runs on a
+# Gluon image (e.g. x86-64 in qemu) or a host where MODEL is set to the
+# image name libplatforminfo reports. The binaries are taken from PATH or
+# from AUTOUPDATER, MIAU_PROXY and AUTOUPDATER_MANIFEST. Needs root,
+# iproute2 with netem, python3 and the ecdsautil tools.
+#
+# For every run the time to update (or to fetch through the proxy), the
+# bytes transferred, the CPU time and the peak RSS are printed, taken from
+# the trace of the autoupdater and the footprint line of miau_proxy, along
+# with the number of connections and requests the mirror got. The budgets
+# are passed to the autoupdater as rss_budget and cpu_budget, which mark
+# its trace, and checked against the footprint of miau_proxy. The exit
+# status is 1 if a run failed or went over a budget.
+
+. "$(dirname "$0")/lib.sh"
+
+SIZE=4096
+ROUNDS=3
+FORMAT=text
+
+while getopts 's:r:bm:c:' opt; do
+	case "$opt" in
+	s)	SIZE="$OPTARG" ;;
+	r)	ROUNDS="$OPTARG" ;;
+	b)	FORMAT=binary ;;
+	m)	BENCH_RSS_BUDGET="$OPTARG" ;;
+	c)	BENCH_CPU_BUDGET="$OPTARG" ;;
+	*)	sed -n '6,12s/^# \?//p' "$0" >&2; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+PROFILES="${*:-lan dsl lte mesh lossy}"
+
+
+bench_init
+
+bench_keys "$BENCH_WORK"
+bench_mirror "$BENCH_WORK/mirror" 2 "$SIZE" "$BENCH_WORK/secret"
+
+bench_ns au-mirror
+bench_ns au-node
+bench_link au-mirror veth0 fdbe:1::1/64 au-node veth0 fdbe:1::2/64
+bench_config au-node "$BENCH_WORK/public" 1 "$FORMAT" "http://[fdbe:1::1]:$BENCH_PORT"
+bench_serve au-mirror "$BENCH_WORK/mirror"
+
+failed=0
+
+printf '%-8s %-12s %3s %9s %10s %8s %9s %6s %5s\n' profile client run 'time/s' bytes 'cpu/s' 'rss/KiB' conns reqs
+
+for profile in $PROFILES; do
+	bench_netem au-mirror veth0 "$profile"
+	bench_netem au-node veth0 "$profile"
+
+	for run in $(seq "$ROUNDS"); do
+		bench_reset_state
+		bench_served_reset au-mirror
+		start="$(bench_now)"
+		ip netns exec au-node "$AUTOUPDATER" -n -f >/dev/null 2>"$BENCH_WORK/log"
+		status=$?
+		end="$(bench_now)"
+
+		note=
+		if [ "$status" != 0 ]; then
+			note=' FAILED'
+		elif bench_trace_over_budget; then
+			note=' OVER BUDGET'
+		fi
+		[ -z "$note" ] || failed=1
+
+		printf '%-8s %-12s %3s %9.2f %10s %8s %9s %6s %5s%s\n' "$profile" autoupdater "$run" \
+			"$(bench_elapsed "$start" "$end")" "$(bench_trace_bytes)" \
+			"$(bench_trace_value cpu)" "$(bench_trace_value rss_peak)" \
+			"$(bench_served au-mirror connect)" "$(bench_served au-mirror request)" "$note"
+	done
+
+	command -v "$MIAU_PROXY" >/dev/null || continue
+
+	for file in "$BENCH_BRANCH.manifest" "gluon-bench-2-$MODEL-sysupgrade.bin"; do
+		for run in $(seq "$ROUNDS"); do
+			bench_served_reset au-mirror
+			start="$(bench_now)"
+			ip netns exec au-node env QUERY_STRING="branch=$BENCH_BRANCH&file=$file" MIAU_PROXY_FOOTPRINT=1 \
+				"$MIAU_PROXY" >"$BENCH_WORK/out" 2>"$BENCH_WORK/log"
+			status=$?
+			end="$(bench_now)"
+
+			# Peak RSS 1234 KiB, peak virtual memory 2345 KiB, CPU 0.010 s user, 0.020 s system
+			footprint="$(grep '^Peak RSS' "$BENCH_WORK/log" | tail -n 1)"
+			rss="$(echo "$footprint" | awk '{ print $3 }')"
+			cpu="$(echo "$footprint" | awk '{ print $11 + $14 }')"
+
+			note=
+			if [ "$status" != 0 ] || [ -z "$footprint" ]; then
+				note=' FAILED'
+			elif bench_over_budget "$rss" "$cpu"; then
+				note=' OVER BUDGET'
+			fi
+			[ -z "$note" ] || failed=1
+
+			printf '%-8s %-12s %3s %9.2f %10s %8s %9s %6s %5s%s\n' "$profile" "proxy:${file##*.}" "$run" \
+				"$(bench_elapsed "$start" "$end")" "$(wc -c < "$BENCH_WORK/out")" "$cpu" "$rss" \
+				"$(bench_served au-mirror connect)" "$(bench_served au-mirror request)" "$note"
+		done
+	done
+done
+
+exit "$failed"
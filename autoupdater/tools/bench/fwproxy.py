@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+#
+# Serves /cgi-bin/fwproxy on port 80 the way uhttpd does on a Gluon node,
+# for the neighbours of mesh.sh.
+#
+# Usage: fwproxy.py <miau_proxy binary>
+#        fwproxy.py --direct <mirror directory>
+#
+# By default every request runs miau_proxy as a CGI program, which fetches
+# the file from the mirrors configured in the namespace. With --direct the
+# file is served from a local directory instead, for testing the autoupdater
+# without a build of miau_proxy.
+
+import http.server
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import urllib.parse
+
+PORT = 80
+PATH = '/cgi-bin/fwproxy'
+
+
+class Server(http.server.ThreadingHTTPServer):
+    address_family = socket.AF_INET6
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    proxy = None
+    mirror = None
+
+    def log_message(self, format, *args):
+        pass
+
+    def do_GET(self):
+        url = urllib.parse.urlsplit(self.path)
+        if url.path != PATH:
+            self.send_error(404)
+        elif self.proxy:
+            self.run_proxy(url.query)
+        else:
+            self.serve_direct(url.query)
+
+    def run_proxy(self, query):
+        env = dict(os.environ, QUERY_STRING=query, REQUEST_METHOD='GET')
+        proc = subprocess.Popen([self.proxy], stdout=subprocess.PIPE, env=env)
+
+        # The CGI header block ends with an empty line. miau_proxy prints
+        # nothing at all if no mirror has the file.
+        status, headers = 200, []
+        while True:
+            line = proc.stdout.readline()
+            if not line:
+                status = 502
+                break
+            line = line.rstrip(b'\r\n').decode('latin-1')
+            if not line:
+                break
+            name, _, value = line.partition(':')
+            if name.lower() == 'status':
+                status = int(value.split()[0])
+            else:
+                headers.append((name, value.strip()))
+
+        self.send_response(status)
+        for name, value in headers:
+            self.send_header(name, value)
+        self.send_header('Connection', 'close')
+        self.end_headers()
+        shutil.copyfileobj(proc.stdout, self.wfile)
+        proc.wait()
+
+    def serve_direct(self, query):
+        params = urllib.parse.parse_qs(query)
+        name = os.path.basename(params.get('file', [''])[0])
+        try:
+            f = open(os.path.join(self.mirror, name), 'rb')
+        except OSError:
+            self.send_error(404)
+            return
+
+        with f:
+            self.send_response(200)
+            self.send_header('Content-Type', 'application/octet-stream')
+            self.send_header('Content-Length', str(os.fstat(f.fileno()).st_size))
+            self.end_headers()
+            shutil.copyfileobj(f, self.wfile)
+
+
+def main():
+    if len(sys.argv) == 3 and sys.argv[1] == '--direct':
+        Handler.mirror = sys.argv[2]
+    elif len(sys.argv) == 2:
+        Handler.proxy = sys.argv[1]
+    else:
+        sys.exit('usage: fwproxy.py <miau_proxy binary> | --direct <mirror directory>')
+
+    Server(('::', PORT), Handler).serve_forever()
+
+
+if __name__ == '__main__':
+    main()
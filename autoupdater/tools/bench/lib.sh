@@ -0,0 +1,240 @@
+# Helpers shared by the benchmark scripts, to be sourced.
+#
+# Everything runs in network namespaces named au-*. `ip netns exec` bind
+# mounts /etc/netns/<namespace>/config over /etc/config, which is how every
+# namespace gets a UCI configuration of its own.
+
+BENCH_BRANCH=bench
+: "${BENCH_DIR:=$(cd "$(dirname "$0")" && pwd)}"
+BENCH_PORT=8080
+BENCH_NAMESPACES=
+BENCH_PIDS=
+# Peak RSS in KiB and CPU time in ms a run may take, empty for no limit
+BENCH_RSS_BUDGET=
+BENCH_CPU_BUDGET=
+
+: "${AUTOUPDATER:=autoupdater}"
+: "${MIAU_PROXY:=/lib/gluon/status-page/www/cgi-bin/fwproxy}"
+: "${AUTOUPDATER_MANIFEST:=autoupdater-manifest}"
+
+
+bench_die() {
+	echo "$0: error: $*" >&2
+	exit 1
+}
+
+bench_require() {
+	[ "$(id -u)" = 0 ] || bench_die 'must be run as root'
+
+	for cmd in ip tc python3 ecdsakeygen ecdsasign sha256sum "$AUTOUPDATER"; do
+		command -v "$cmd" >/dev/null || bench_die "$cmd not found"
+	done
+
+	if [ -z "$MODEL" ]; then
+		MODEL="$(lua -e 'print(require("platform_info").get_image_name())' 2>/dev/null)"
+		[ -n "$MODEL" ] || bench_die 'unable to determine the image name, set MODEL'
+	fi
+}
+
+bench_cleanup() {
+	for pid in $BENCH_PIDS; do
+		kill "$pid" 2>/dev/null
+	done
+	for ns in $BENCH_NAMESPACES; do
+		ip netns del "$ns" 2>/dev/null
+		rm -rf "/etc/netns/$ns"
+	done
+	[ -n "$BENCH_WORK" ] && rm -rf "$BENCH_WORK"
+}
+
+bench_init() {
+	bench_require
+	BENCH_WORK="$(mktemp -d)"
+	trap bench_cleanup EXIT
+	trap 'exit 1' INT TERM
+}
+
+
+# bench_keys <dir>: creates a test key pair as <dir>/secret and <dir>/public
+bench_keys() {
+	ecdsakeygen -s > "$1/secret"
+	ecdsakeygen -p < "$1/secret" > "$1/public"
+}
+
+# bench_sign <manifest> <secret>: signs a manifest the way contrib/sign.sh does
+bench_sign() {
+	local upper="$BENCH_WORK/upper"
+
+	sed '/^---$/,$d' "$1" > "$upper"
+	ecdsasign "$2" < "$upper" >> "$1"
+	rm -f "$upper"
+}
+
+# bench_mirror <dir> <version> <image size in KiB> <secret>: creates a signed
+# manifest, its binary form if the tool is available and a random image
+bench_mirror() {
+	local dir="$1" version="$2" size="$3" secret="$4"
+	local image="gluon-bench-$version-$MODEL-sysupgrade.bin"
+	local manifest="$dir/$BENCH_BRANCH.manifest"
+
+	mkdir -p "$dir"
+	dd if=/dev/urandom of="$dir/$image" bs=1024 count="$size" 2>/dev/null
+
+	cat > "$manifest" <<-END
+	BRANCH=$BENCH_BRANCH
+	DATE=$(date -u '+%Y-%m-%d %H:%M:%S+00:00')
+	PRIORITY=0
+
+	$MODEL $version $(sha256sum "$dir/$image" | cut -d' ' -f1) $((size * 1024)) $image
+	---
+	END
+	bench_sign "$manifest" "$secret"
+
+	if command -v "$AUTOUPDATER_MANIFEST" >/dev/null; then
+		"$AUTOUPDATER_MANIFEST" compile "$manifest" "$manifest.bin" &&
+		"$AUTOUPDATER_MANIFEST" sign "$manifest.bin" \
+			"$("$AUTOUPDATER_MANIFEST" header "$manifest.bin" | ecdsasign "$secret")"
+	fi
+}
+
+# bench_config <namespace> <public key file> <old version> <manifest format> <mirror> ...:
+# also sets the budgets of BENCH_RSS_BUDGET and BENCH_CPU_BUDGET
+bench_config() {
+	local ns="$1" pubkey="$2" version="$3" format="$4"
+	local dir="/etc/netns/$ns/config"
+	shift 4
+
+	mkdir -p "$dir"
+	echo "$version" > "$BENCH_WORK/$ns.version"
+
+	cat > "$dir/autoupdater" <<-END
+	config autoupdater 'settings'
+		option enabled '1'
+		option branch '$BENCH_BRANCH'
+		option version_file '$BENCH_WORK/$ns.version'
+		option manifest_format '$format'
+	END
+
+	[ -z "$BENCH_RSS_BUDGET" ] || printf "\toption rss_budget '%s'\n" "$BENCH_RSS_BUDGET" >> "$dir/autoupdater"
+	[ -z "$BENCH_CPU_BUDGET" ] || printf "\toption cpu_budget '%s'\n" "$BENCH_CPU_BUDGET" >> "$dir/autoupdater"
+
+	cat >> "$dir/autoupdater" <<-END
+
+	config branch '$BENCH_BRANCH'
+		option name '$BENCH_BRANCH'
+		option good_signatures '1'
+		list pubkey '$(cat "$pubkey")'
+	END
+
+	for mirror in "$@"; do
+		printf "\tlist mirror '%s'\n" "$mirror" >> "$dir/autoupdater"
+	done
+}
+
+
+bench_ns() {
+	ip netns add "$1" || bench_die "unable to create namespace $1"
+	BENCH_NAMESPACES="$BENCH_NAMESPACES $1"
+	ip -n "$1" link set lo up
+	# Link-local addresses are usable right away
+	ip netns exec "$1" sysctl -qw net.ipv6.conf.all.accept_dad=0 net.ipv6.conf.default.accept_dad=0
+}
+
+# bench_link <namespace> <interface> <address> <namespace> <interface> <address>:
+# connects two namespaces by a veth pair, addresses are given with prefix
+bench_link() {
+	ip link add "$2" netns "$1" type veth peer name "$5" netns "$4" || bench_die 'unable to create veth pair'
+	ip -n "$1" link set "$2" up
+	ip -n "$4" link set "$5" up
+	[ -n "$3" ] && ip -n "$1" addr add "$3" dev "$2" nodad
+	[ -n "$6" ] && ip -n "$4" addr add "$6" dev "$5" nodad
+}
+
+# Network profiles: one-way delay and jitter, rate and loss, applied in both directions
+bench_profile() {
+	case "$1" in
+	lan)	echo 'delay 1ms rate 1000mbit' ;;
+	dsl)	echo 'delay 15ms 2ms rate 16mbit' ;;
+	lte)	echo 'delay 40ms 10ms rate 8mbit loss 0.5%' ;;
+	mesh)	echo 'delay 8ms 4ms rate 5mbit loss 1%' ;;
+	lossy)	echo 'delay 60ms 20ms rate 2mbit loss 3%' ;;
+	*)	return 1 ;;
+	esac
+}
+
+# bench_netem <namespace> <interface> <profile>
+bench_netem() {
+	local netem
+
+	netem="$(bench_profile "$3")" || bench_die "unknown profile $3"
+	# shellcheck disable=SC2086
+	ip netns exec "$1" tc qdisc replace dev "$2" root netem $netem || bench_die 'unable to set up netem'
+}
+
+# bench_serve <namespace> <dir>: serves a directory by HTTP on BENCH_PORT,
+# logging connections and requests to $BENCH_WORK/<namespace>.log
+bench_serve() {
+	: > "$BENCH_WORK/$1.log"
+	ip netns exec "$1" python3 "$BENCH_DIR/mirror.py" "$BENCH_PORT" "$2" "$BENCH_WORK/$1.log" >/dev/null 2>&1 &
+	BENCH_PIDS="$BENCH_PIDS $!"
+	sleep 1
+}
+
+# bench_served <namespace> <connect|request>: prints how many connections or
+# requests the server of a namespace got since it was started or reset
+bench_served() {
+	awk -v kind="$2" '$1 == kind { n++ } END { print n + 0 }' "$BENCH_WORK/$1.log"
+}
+
+bench_served_reset() {
+	: > "$BENCH_WORK/$1.log"
+}
+
+
+# Monotonic time in seconds, with the resolution of /proc/uptime
+bench_now() {
+	cut -d' ' -f1 /proc/uptime
+}
+
+bench_elapsed() {
+	awk "BEGIN { print $2 - $1 }"
+}
+
+# Forgets everything the autoupdater learned in earlier runs
+bench_reset_state() {
+	rm -f /tmp/autoupdater.backoff /tmp/autoupdater.cache /tmp/autoupdater.validators \
+		/tmp/autoupdater.history /tmp/autoupdater.trace
+}
+
+# bench_trace_value <key>: prints a number from the last trace line
+bench_trace_value() {
+	tail -n 1 /tmp/autoupdater.trace 2>/dev/null | grep -o "\"$1\":[0-9.]*" | head -n 1 | cut -d: -f2
+}
+
+# bench_trace_over_budget: succeeds if the last trace line is marked over budget
+bench_trace_over_budget() {
+	tail -n 1 /tmp/autoupdater.trace 2>/dev/null | grep -q '"over_budget":true'
+}
+
+# bench_over_budget <rss in KiB> <cpu in s>: succeeds if a footprint exceeds
+# BENCH_RSS_BUDGET or BENCH_CPU_BUDGET
+bench_over_budget() {
+	[ -n "$BENCH_RSS_BUDGET" ] && [ "${1:-0}" -gt "$BENCH_RSS_BUDGET" ] && return 0
+	[ -n "$BENCH_CPU_BUDGET" ] && awk "BEGIN { exit !($2 * 1000 > $BENCH_CPU_BUDGET) }" && return 0
+	return 1
+}
+
+# bench_trace_phase <phase>: prints the wall time of a phase from the last trace line
+bench_trace_phase() {
+	tail -n 1 /tmp/autoupdater.trace 2>/dev/null | grep -o "\"$1\":{\"wall\":[0-9.]*" | cut -d: -f3
+}
+
+# bench_trace_source <request>: prints where a request of the last trace line went to
+bench_trace_source() {
+	tail -n 1 /tmp/autoupdater.trace 2>/dev/null | grep -o "\"$1_request\":{\"source\":\"[^\"]*\"" | cut -d'"' -f6
+}
+
+# Prints the bytes transferred by the requests in the last trace line
+bench_trace_bytes() {
+	tail -n 1 /tmp/autoupdater.trace 2>/dev/null | grep -o '"bytes":[0-9]*' | cut -d: -f2 | awk '{ s += $1 } END { print s + 0 }'
+}
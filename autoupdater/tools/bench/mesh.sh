@@ -0,0 +1,176 @@
+#!/bin/sh
+#
+# Testbed for updating through mesh neighbours: an isolated node without a
+# route to any mirror discovers its neighbours by respondd and fetches the
+# update through their fwproxy.
+#
+# Usage: mesh.sh [-n <neighbours>] [-s <image size in KiB>] [-r <rounds>] [-p <profile>] [-l <ms>] [-d] [-m <KiB>] [-c <ms>]
+#
+#   -n  number of neighbours, 3 by default
+#   -s  size of the generated image, 1024 KiB by default
+#   -r  number of runs, 3 by default
+#   -p  netem profile of the mesh links (see lib.sh), mesh by default, none to disable
+#   -l  delay of the respondd answers in ms, 0 by default
+#   -d  neighbours serve the image themselves instead of running miau_proxy
+#   -m  peak RSS budget of a run of the autoupdater, no limit by default
+#   -c  CPU time budget of a run of the autoupdater, no limit by default
+#
+# Every node is a network namespace. The isolated node au-iso is connected
+# to each neighbour au-n<i> by a veth pair mesh<i> <-> mesh0 carrying only
+# link-local IPv6, like a mesh VPN or a wired mesh link. The neighbours
+# reach the mirror au-mirror by veth pairs of their own.
+#
+# Each neighbour runs respondd.py on port 1001, announcing a newer firmware,
+# and fwproxy.py on port 80, which runs miau_proxy as a CGI program. The
+# isolated node gets a private ubusd in a mount namespace of its own, where
+# netifd.lua presents the mesh<i> interfaces in the network.interface dump
+# for gluonutil_get_mesh_interfaces(). Its mirror is unreachable, so every
+# update goes through a neighbour.
+#
+# For every run the number of neighbours found, the discovery latency, the
+# time until a valid manifest, the time to update, the bytes transferred and
+# the neighbour the image came from are printed, taken from the trace of the
+# autoupdater. The exit status is 1 if a run failed or went over a budget,
+# which the autoupdater gets as rss_budget and cpu_budget. Besides what bench.sh needs, this needs unshare, nsenter,
+# ubusd, the ubus tool and lua with the ubus and uloop modules, so it is
+# meant to be run on a Gluon image (e.g. x86-64 in qemu).
+
+BENCH_DIR="$(cd "$(dirname "$0")" && pwd)"
+. "$BENCH_DIR/lib.sh"
+
+NEIGHBOURS=3
+SIZE=1024
+ROUNDS=3
+PROFILE=mesh
+DELAY=0
+DIRECT=
+
+while getopts 'n:s:r:p:l:dm:c:' opt; do
+	case "$opt" in
+	n)	NEIGHBOURS="$OPTARG" ;;
+	s)	SIZE="$OPTARG" ;;
+	r)	ROUNDS="$OPTARG" ;;
+	p)	PROFILE="$OPTARG" ;;
+	l)	DELAY="$OPTARG" ;;
+	d)	DIRECT=1 ;;
+	m)	BENCH_RSS_BUDGET="$OPTARG" ;;
+	c)	BENCH_CPU_BUDGET="$OPTARG" ;;
+	*)	sed -n '7,16s/^# \?//p' "$0" >&2; exit 1 ;;
+	esac
+done
+
+[ "$NEIGHBOURS" -ge 1 ] 2>/dev/null || bench_die 'at least one neighbour is needed'
+
+
+# Starts the respondd stand-in and the fwproxy of neighbour <i>
+mesh_neighbour() {
+	local ns="au-n$1"
+
+	ip netns exec "$ns" python3 "$BENCH_DIR/respondd.py" "bench-$1" 2 "$DELAY" >/dev/null 2>&1 &
+	BENCH_PIDS="$BENCH_PIDS $!"
+
+	if [ -n "$DIRECT" ]; then
+		ip netns exec "$ns" python3 "$BENCH_DIR/fwproxy.py" --direct "$BENCH_WORK/mirror" >/dev/null 2>&1 &
+	else
+		# miau_proxy takes a lock in /tmp, which every neighbour needs for itself
+		touch /tmp/miau.lock "$BENCH_WORK/$ns.lock"
+		ip netns exec "$ns" unshare -m sh -c 'mount --bind "$1" /tmp/miau.lock && exec python3 "$2" "$3"' \
+			- "$BENCH_WORK/$ns.lock" "$BENCH_DIR/fwproxy.py" "$MIAU_PROXY" >/dev/null 2>&1 &
+	fi
+	BENCH_PIDS="$BENCH_PIDS $!"
+}
+
+# Starts the ubusd of the isolated node with the mock of netifd. The shell
+# holding the mount namespace writes its PID to $BENCH_WORK/au-iso.pid.
+mesh_ubus() {
+	local interfaces=
+
+	for i in $(seq "$NEIGHBOURS"); do
+		interfaces="$interfaces mesh$i"
+	done
+
+	# shellcheck disable=SC2016,SC2086
+	ip netns exec au-iso unshare -m sh -c '
+		pidfile="$1"; netifd="$2"; shift 2
+		mount -t tmpfs ubus /var/run || exit 1
+		mkdir -p /var/run/ubus
+		ubusd & ubusd=$!
+		sleep 1
+		lua "$netifd" "$@" & netifd=$!
+		trap "kill $ubusd $netifd; exit" TERM
+		echo $$ > "$pidfile"
+		wait' - "$BENCH_WORK/au-iso.pid" "$BENCH_DIR/netifd.lua" $interfaces >/dev/null 2>&1 &
+	BENCH_PIDS="$BENCH_PIDS $!"
+
+	for i in $(seq 10); do
+		[ -s "$BENCH_WORK/au-iso.pid" ] && break
+		sleep 1
+	done
+	[ -s "$BENCH_WORK/au-iso.pid" ] || bench_die 'unable to start ubusd'
+
+	mesh_exec ubus -t 10 wait_for network.interface || bench_die 'the mock of netifd did not come up'
+}
+
+# Runs a command on the isolated node
+mesh_exec() {
+	nsenter -t "$(cat "$BENCH_WORK/au-iso.pid")" -m -n "$@"
+}
+
+
+bench_init
+for cmd in unshare nsenter ubusd ubus lua; do
+	command -v "$cmd" >/dev/null || bench_die "$cmd not found"
+done
+[ -n "$DIRECT" ] || command -v "$MIAU_PROXY" >/dev/null || bench_die "$MIAU_PROXY not found, use -d"
+
+bench_keys "$BENCH_WORK"
+bench_mirror "$BENCH_WORK/mirror" 2 "$SIZE" "$BENCH_WORK/secret"
+
+bench_ns au-mirror
+bench_ns au-iso
+bench_serve au-mirror "$BENCH_WORK/mirror"
+
+for i in $(seq "$NEIGHBOURS"); do
+	bench_ns "au-n$i"
+	bench_link au-iso "mesh$i" '' "au-n$i" mesh0 ''
+	bench_link au-mirror "n$i" "fdbe:2:$i::1/64" "au-n$i" up0 "fdbe:2:$i::2/64"
+	bench_config "au-n$i" "$BENCH_WORK/public" 2 text "http://[fdbe:2:$i::1]:$BENCH_PORT"
+
+	if [ "$PROFILE" != none ]; then
+		bench_netem au-iso "mesh$i" "$PROFILE"
+		bench_netem "au-n$i" mesh0 "$PROFILE"
+	fi
+
+	mesh_neighbour "$i"
+done
+
+# Nothing listens there, so the isolated node has to go through its neighbours
+bench_config au-iso "$BENCH_WORK/public" 1 text "http://[fdbe:ffff::1]:$BENCH_PORT"
+mesh_ubus
+sleep 1
+
+failed=0
+
+printf '%3s %10s %12s %11s %9s %10s  %s\n' run neighbours 'discovery/s' 'manifest/s' 'time/s' bytes source
+
+for run in $(seq "$ROUNDS"); do
+	bench_reset_state
+	start="$(bench_now)"
+	mesh_exec "$AUTOUPDATER" -n -f >"$BENCH_WORK/out" 2>"$BENCH_WORK/log"
+	status=$?
+	end="$(bench_now)"
+
+	note=
+	if [ "$status" != 0 ]; then
+		note=' FAILED'
+	elif bench_trace_over_budget; then
+		note=' OVER BUDGET'
+	fi
+	[ -z "$note" ] || failed=1
+
+	printf '%3s %10s %12s %11s %9.2f %10s  %s%s\n' "$run" "$(grep -c '^Neighbour ' "$BENCH_WORK/out")" \
+		"$(bench_trace_phase discovery)" "$(bench_trace_phase manifest)" \
+		"$(bench_elapsed "$start" "$end")" "$(bench_trace_bytes)" "$(bench_trace_source image)" "$note"
+done
+
+exit "$failed"
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+#
+# Static file server standing in for a firmware mirror, for bench.sh and
+# mesh.sh. Unlike python3 -m http.server it keeps connections alive, and
+# answers range and conditional requests, like the web servers mirrors
+# usually run.
+#
+# Usage: mirror.py <port> <directory> <log file>
+#
+# Every new connection is logged as "connect <peer>", every request as
+# "request <status> <path>", so the benchmarks can tell how many
+# connections a client needed.
+
+import email.utils
+import hashlib
+import http.server
+import os
+import re
+import socket
+import sys
+import threading
+
+
+class Server(http.server.ThreadingHTTPServer):
+    address_family = socket.AF_INET6
+    daemon_threads = True
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+    directory = None
+    log = None
+    lock = threading.Lock()
+
+    def setup(self):
+        super().setup()
+        self.record('connect', self.client_address[0])
+
+    def record(self, *fields):
+        with self.lock:
+            self.log.write(' '.join(str(f) for f in fields) + '\n')
+            self.log.flush()
+
+    def log_message(self, format, *args):
+        pass
+
+    def send_response(self, code, message=None):
+        self.record('request', code, self.path)
+        super().send_response(code, message)
+
+    def do_HEAD(self):
+        self.serve(False)
+
+    def do_GET(self):
+        self.serve(True)
+
+    def serve(self, body):
+        name = os.path.basename(self.path.split('?', 1)[0])
+        try:
+            f = open(os.path.join(self.directory, name), 'rb')
+        except OSError:
+            self.send_error(404)
+            return
+
+        with f:
+            st = os.fstat(f.fileno())
+            etag = '"%s"' % hashlib.md5(b'%d-%d' % (st.st_ino, st.st_mtime_ns)).hexdigest()
+            last_modified = email.utils.formatdate(st.st_mtime, usegmt=True)
+
+            if self.not_modified(etag, st.st_mtime):
+                self.send_response(304)
+                self.send_header('ETag', etag)
+                self.end_headers()
+                return
+
+            start, end = 0, st.st_size - 1
+            status = 200
+            m = re.fullmatch(r'bytes=(\d*)-(\d*)', self.headers.get('Range', ''))
+            if m and (m.group(1) or m.group(2)):
+                if m.group(1):
+                    start = int(m.group(1))
+                    end = min(int(m.group(2)), end) if m.group(2) else end
+                else:
+                    start = max(st.st_size - int(m.group(2)), 0)
+                if start > end:
+                    self.send_response(416)
+                    self.send_header('Content-Range', 'bytes */%d' % st.st_size)
+                    self.send_header('Content-Length', '0')
+                    self.end_headers()
+                    return
+                status = 206
+
+            self.send_response(status)
+            self.send_header('Content-Type', 'application/octet-stream')
+            self.send_header('Content-Length', str(end - start + 1))
+            self.send_header('ETag', etag)
+            self.send_header('Last-Modified', last_modified)
+            self.send_header('Accept-Ranges', 'bytes')
+            if status == 206:
+                self.send_header('Content-Range', 'bytes %d-%d/%d' % (start, end, st.st_size))
+            self.end_headers()
+
+            if body:
+                f.seek(start)
+                copy(f, self.wfile, end - start + 1)
+
+    def not_modified(self, etag, mtime):
+        if 'If-None-Match' in self.headers:
+            return etag in [t.strip() for t in self.headers['If-None-Match'].split(',')]
+
+        since = self.headers.get('If-Modified-Since')
+        if since:
+            try:
+                return int(mtime) <= email.utils.parsedate_to_datetime(since).timestamp()
+            except (TypeError, ValueError):
+                pass
+        return False
+
+
+def copy(src, dst, length):
+    while length > 0:
+        chunk = src.read(min(length, 65536))
+        if not chunk:
+            break
+        dst.write(chunk)
+        length -= len(chunk)
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit('usage: mirror.py <port> <directory> <log file>')
+
+    Handler.directory = sys.argv[2]
+    Handler.log = open(sys.argv[3], 'a')
+    Server(('::', int(sys.argv[1])), Handler).serve_forever()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,44 @@
+#!/usr/bin/lua
+--
+-- Mock of the network.interface object of netifd, for mesh.sh. Only the
+-- dump method is provided, with what gluonutil_get_mesh_interfaces() looks
+-- at: every device given on the command line becomes an interface with the
+-- gluon_mesh protocol that is up.
+--
+-- Usage: netifd.lua <device> ...
+
+local ubus = require 'ubus'
+local uloop = require 'uloop'
+
+local interfaces = {}
+for i, device in ipairs(arg) do
+	table.insert(interfaces, {
+		interface = 'mesh_' .. device,
+		up = true,
+		pending = false,
+		available = true,
+		proto = 'gluon_mesh',
+		device = device,
+		l3_device = device,
+	})
+end
+
+uloop.init()
+
+local conn = ubus.connect()
+if not conn then
+	io.stderr:write('netifd.lua: unable to connect to ubus\n')
+	os.exit(1)
+end
+
+conn:add({
+	['network.interface'] = {
+		dump = {
+			function(req, msg)
+				conn:reply(req, { interface = interfaces })
+			end, {}
+		},
+	},
+})
+
+uloop.run()
@@ -0,0 +1,46 @@
+#!/usr/bin/env python3
+#
+# Stand-in for respondd, answering nodeinfo queries on UDP port 1001 the
+# way a Gluon node does. Used by mesh.sh.
+#
+# Usage: respondd.py <node id> <firmware release> [<delay in ms>]
+#
+# The delay is added before every answer, to emulate a busy node.
+
+import json
+import socket
+import sys
+import time
+
+PORT = 1001
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit('usage: respondd.py <node id> <firmware release> [<delay in ms>]')
+
+    node_id, release = sys.argv[1], sys.argv[2]
+    delay = int(sys.argv[3]) / 1000 if len(sys.argv) > 3 else 0
+
+    nodeinfo = json.dumps({
+        'node_id': node_id,
+        'hostname': 'bench-' + node_id,
+        'software': {'firmware': {'base': 'gluon-bench', 'release': release}},
+    }).encode()
+
+    # Queries are sent to ff02::1, which every interface is a member of
+    sock = socket.socket(socket.AF_INET6, socket.SOCK_DGRAM)
+    sock.bind(('::', PORT))
+
+    while True:
+        query, peer = sock.recvfrom(1500)
+        if query.strip() != b'nodeinfo':
+            continue
+
+        if delay:
+            time.sleep(delay)
+        sock.sendto(nodeinfo, peer)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,149 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/*
+ * Checks every SHA256 backend of hash.c available on this system against
+ * known digests and prints its throughput. Exits with status 1 if a backend
+ * computes a wrong digest.
+ */
+
+
+#include "hash.h"
+#include "util.h"
+
+#include <hexutil.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define BENCHMARK_SIZE (4 * 1024 * 1024)
+/* The image download hands the data to the hasher in chunks of this size */
+#define BENCHMARK_CHUNK (16 * 1024)
+
+
+struct test_vector {
+	const char *data;
+	size_t repeat;
+	const char *digest;
+};
+
+static const struct test_vector vectors[] = {
+	{ "", 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+	{ "abc", 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+	{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+	  "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+	{ "a", 1000000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+};
+
+
+/** Hashes the data in pieces of growing size, to cover every way a block can be split up */
+static void hash_pieces(const struct hash_backend *b, const unsigned char *data, size_t len, unsigned char *out) {
+	struct hash_ctx ctx = { .backend = b };
+
+	b->init(&ctx);
+	for (size_t off = 0, piece = 1; off < len; off += piece, piece = piece % 131 + 1)
+		b->update(&ctx, data + off, len - off < piece ? len - off : piece);
+	b->final(&ctx, out);
+}
+
+static bool check(const struct hash_backend *b, const struct hash_backend *reference) {
+	unsigned char out[HASH_SIZE], expected[HASH_SIZE];
+
+	for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+		const struct test_vector *v = &vectors[i];
+		struct hash_ctx ctx = { .backend = b };
+
+		b->init(&ctx);
+		for (size_t j = 0; j < v->repeat; j++)
+			b->update(&ctx, v->data, strlen(v->data));
+		b->final(&ctx, out);
+
+		if (!parsehex(expected, v->digest, HASH_SIZE) || memcmp(out, expected, HASH_SIZE))
+			return false;
+	}
+
+	/* All lengths up to a few blocks, against the portable implementation */
+	unsigned char data[4 * HASH_BLOCK_SIZE + 1];
+	for (size_t i = 0; i < sizeof(data); i++)
+		data[i] = rand();
+
+	for (size_t len = 0; len <= sizeof(data); len++) {
+		hash_pieces(b, data, len, out);
+		hash_pieces(reference, data, len, expected);
+
+		if (memcmp(out, expected, HASH_SIZE))
+			return false;
+	}
+
+	return true;
+}
+
+static double benchmark(const struct hash_backend *b) {
+	unsigned char *data = safe_malloc(BENCHMARK_SIZE);
+	memset(data, 0x5a, BENCHMARK_SIZE);
+
+	struct hash_ctx ctx = { .backend = b };
+	unsigned char out[HASH_SIZE];
+	double start = get_time();
+
+	b->init(&ctx);
+	for (size_t off = 0; off < BENCHMARK_SIZE; off += BENCHMARK_CHUNK)
+		b->update(&ctx, data + off, BENCHMARK_CHUNK);
+	b->final(&ctx, out);
+
+	double elapsed = get_time() - start;
+	free(data);
+
+	return BENCHMARK_SIZE / elapsed / (1024 * 1024);
+}
+
+int main(void) {
+	size_t n;
+	const struct hash_backend *backends = hash_get_backends(&n);
+	/* The portable implementation comes last */
+	const struct hash_backend *reference = &backends[n - 1];
+	bool ok = true;
+
+	for (size_t i = 0; i < n; i++) {
+		const struct hash_backend *b = &backends[i];
+		if (!b->available()) {
+			printf("%-10s unavailable\n", b->name);
+			continue;
+		}
+
+		if (!check(b, reference)) {
+			printf("%-10s FAILED\n", b->name);
+			ok = false;
+			continue;
+		}
+
+		printf("%-10s %8.2f MiB/s\n", b->name, benchmark(b));
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/*
+ * Checks the hexadecimal codec of hexutil.c against a plain table lookup and
+ * prints its throughput for typical input sizes. Exits with status 1 if the
+ * check fails.
+ */
+
+
+#include "util.h"
+
+#include <hexutil.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#define BENCHMARK_MAX_LEN 4096
+#define BENCHMARK_BYTES (64 * 1024 * 1024)
+
+
+static int digit_value(unsigned char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/** The obvious decoder, for reference */
+static bool decode_reference(unsigned char *output, const char *input, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		int hi = digit_value(input[2*i]), lo = digit_value(input[2*i + 1]);
+		if (hi < 0 || lo < 0)
+			return false;
+
+		output[i] = (hi << 4) | lo;
+	}
+
+	return true;
+}
+
+/** Compares the decoder against the reference for all lengths up to 80 bytes and every kind of invalid input */
+static bool check(void) {
+	static const char invalid[] = { '/', ':', '@', 'G', '`', 'g', ' ', 'x', '\x80', '\xb0', '\xe1', '\xff' };
+	unsigned char bytes[80] = {}, decoded[80], expected[80];
+	char hex[2 * sizeof(bytes) + 1];
+
+	for (size_t len = 0; len <= sizeof(bytes); len++) {
+		for (size_t i = 0; i < len; i++)
+			bytes[i] = rand();
+		formathex(hex, bytes, len);
+
+		/* Mixed case */
+		for (size_t i = 0; i < 2*len; i++) {
+			if (hex[i] >= 'a' && (rand() & 1))
+				hex[i] -= 'a' - 'A';
+		}
+
+		if (!parsehex(decoded, hex, len) || memcmp(decoded, bytes, len))
+			return false;
+		if (!decode_reference(expected, hex, len) || memcmp(expected, bytes, len))
+			return false;
+
+		/* Wrong number of digits */
+		if (len && parsehex(decoded, hex, len - 1))
+			return false;
+		if (parsehex(decoded, hex, len + 1))
+			return false;
+
+		for (size_t i = 0; i < 2*len; i++) {
+			char c = hex[i];
+			hex[i] = invalid[rand() % sizeof(invalid)];
+			bool accepted = parsehex(decoded, hex, len);
+			hex[i] = c;
+
+			if (accepted)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+int main(void) {
+	static const size_t sizes[] = { 32, 64, BENCHMARK_MAX_LEN };
+
+	unsigned char bytes[BENCHMARK_MAX_LEN], decoded[BENCHMARK_MAX_LEN];
+	char hex[2 * BENCHMARK_MAX_LEN + 1];
+	bool ok = true;
+
+	srand(time(NULL));
+	if (!check()) {
+		fputs("hexutil-test: decoder differs from the reference\n", stderr);
+		ok = false;
+	}
+
+	for (size_t i = 0; i < sizeof(bytes); i++)
+		bytes[i] = rand();
+	formathex(hex, bytes, sizeof(bytes));
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		size_t len = sizes[i], rounds = BENCHMARK_BYTES / (2 * len);
+		double start, reference, hexutil;
+		bool decoded_ok = true;
+
+		start = get_time();
+		for (size_t round = 0; round < rounds; round++)
+			decoded_ok = decode_reference(decoded, hex, len) && decoded_ok;
+		reference = get_time() - start;
+
+		start = get_time();
+		for (size_t round = 0; round < rounds; round++)
+			decoded_ok = hexdecode(decoded, hex, len) && decoded_ok;
+		hexutil = get_time() - start;
+
+		if (!decoded_ok || memcmp(decoded, bytes, len)) {
+			fprintf(stderr, "hexutil-test: decoding %zu bytes failed\n", len);
+			ok = false;
+		}
+
+		printf("%4zu bytes: reference %8.2f MiB/s, hexdecode %8.2f MiB/s\n", len,
+		       rounds * 2 * len / reference / (1024 * 1024), rounds * 2 * len / hexutil / (1024 * 1024));
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/*
+ * Feeds a large synthetic manifest to the incremental parser of manifest.c
+ * in chunks of various sizes, checks what it extracts and prints its speed.
+ * Exits with status 1 if the parser gets anything wrong.
+ */
+
+
+#include "manifest.h"
+#include "util.h"
+
+#include <hexutil.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define BENCHMARK_MODELS 1000
+#define BENCHMARK_ROUNDS 100
+#define BENCHMARK_SIGNATURES 3
+
+
+static const char *const image_name = "benchmark-model";
+
+
+/** Parses the manifest in chunks of the given size and checks the result */
+static bool parse(const char *buf, size_t len, size_t chunk, const unsigned char *expected_hash) {
+	struct manifest m = {};
+	struct manifest_parser p;
+	unsigned char hash[HASH_SIZE];
+
+	hash_init(&m.hash_ctx);
+	manifest_parser_init(&p, &m, "stable", image_name);
+	for (size_t off = 0; off < len; off += chunk)
+		manifest_parser_feed(&p, buf + off, len - off < chunk ? len - off : chunk);
+	manifest_parser_free(&p);
+	hash_final(&m.hash_ctx, hash);
+
+	bool ok = m.branch_ok && m.date_ok && m.priority_ok && m.model_ok
+		&& !strcmp(m.version, "2020.1.0") && m.imagesize == 7340036
+		&& m.n_signatures == BENCHMARK_SIGNATURES
+		&& !memcmp(hash, expected_hash, HASH_SIZE);
+
+	clear_manifest(&m);
+	return ok;
+}
+
+int main(void) {
+	static const size_t check_chunk_sizes[] = { 1, 2, 3, 7, 64, 1000 };
+	static const size_t chunk_sizes[] = { 512, 4096, 16384 };
+
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *f = open_memstream(&buf, &len);
+	if (!f) {
+		fputs("manifest-test: unable to create the manifest\n", stderr);
+		return 1;
+	}
+
+	fputs("BRANCH=stable\nDATE=2020-01-01 00:00:00+00:00\nPRIORITY=0\n\n", f);
+	/* Our own model comes last, so every other line has to be skipped */
+	for (unsigned i = 0; i < BENCHMARK_MODELS; i++) {
+		char model[64];
+		if (i < BENCHMARK_MODELS - 1)
+			snprintf(model, sizeof(model), "vendor-device-%04u-v1", i);
+		else
+			snprintf(model, sizeof(model), "%s", image_name);
+
+		fprintf(f, "%s 2020.1.0 %064x 7340036 gluon-site-2020.1.0-%s-sysupgrade.bin\n", model, i, model);
+	}
+	long signed_len = ftell(f);
+	fputs("---\n", f);
+	for (unsigned i = 0; i < BENCHMARK_SIGNATURES; i++)
+		fprintf(f, "%0128x\n", i);
+	fclose(f);
+
+	/* The signatures cover everything in front of the separator */
+	struct hash_ctx ctx;
+	unsigned char expected_hash[HASH_SIZE];
+	hash_init(&ctx);
+	hash_update(&ctx, buf, signed_len);
+	hash_final(&ctx, expected_hash);
+
+	bool ok = true;
+
+	for (size_t i = 0; i < sizeof(check_chunk_sizes) / sizeof(check_chunk_sizes[0]); i++) {
+		if (!parse(buf, len, check_chunk_sizes[i], expected_hash)) {
+			fprintf(stderr, "manifest-test: parsing in chunks of %zu bytes failed\n", check_chunk_sizes[i]);
+			ok = false;
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++) {
+		size_t chunk = chunk_sizes[i];
+		bool parsed = true;
+		double start = get_time();
+
+		for (unsigned round = 0; round < BENCHMARK_ROUNDS; round++)
+			parsed = parse(buf, len, chunk, expected_hash) && parsed;
+
+		double elapsed = get_time() - start;
+		printf("%5zu byte chunks: %8.2f MiB/s, %6.2f ms per manifest of %zu KiB%s\n",
+		       chunk, BENCHMARK_ROUNDS * len / elapsed / (1024 * 1024),
+		       elapsed * 1000 / BENCHMARK_ROUNDS, len / 1024, parsed ? "" : " (PARSE ERROR)");
+
+		ok = ok && parsed;
+	}
+
+	free(buf);
+	return ok ? 0 : 1;
+}
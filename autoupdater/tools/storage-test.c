@@ -0,0 +1,183 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/*
+ * Checks where plan_download() stages images: in tmpfs, in the first image
+ * storage with enough room, or nowhere. The memory is read from a generated
+ * meminfo file and the free space of every directory is taken from a
+ * table. Exits with status 1 if a plan differs from the expected one.
+ */
+
+
+#include "storage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#define MIB(n) ((int64_t)(n) * 1024 * 1024)
+
+struct fs {
+	const char *path;
+	int64_t available;
+};
+
+struct scenario {
+	const char *name;
+	const char *meminfo;
+	struct fs fs[4];
+	ssize_t imagesize;
+	bool ok;
+	enum download_target target;
+	const char *path;
+};
+
+
+/* /mnt/missing isn't in any table, so it can't be accessed */
+static const char *storage[] = { "/mnt/missing", "/mnt/small", "/mnt/large" };
+
+static const struct scenario scenarios[] = {
+	{
+		.name = "tmpfs",
+		.meminfo = "MemTotal: 126976 kB\nMemFree: 20480 kB\nMemAvailable: 65536 kB\nCached: 32768 kB\n",
+		.fs = { { "/tmp", MIB(32) }, { "/mnt/small", MIB(1) }, { "/mnt/large", MIB(64) } },
+		.imagesize = MIB(8),
+		.ok = true,
+		.target = DOWNLOAD_TARGET_TMPFS,
+		.path = "/tmp/firmware.bin",
+	},
+	{
+		.name = "tmpfs without MemAvailable",
+		.meminfo = "MemTotal: 126976 kB\nMemFree: 8192 kB\nCached: 8192 kB\n",
+		.fs = { { "/tmp", MIB(32) }, { "/mnt/large", MIB(64) } },
+		.imagesize = MIB(8),
+		.ok = true,
+		.target = DOWNLOAD_TARGET_TMPFS,
+		.path = "/tmp/firmware.bin",
+	},
+	{
+		.name = "unknown memory",
+		.meminfo = "",
+		.fs = { { "/tmp", MIB(32) }, { "/mnt/large", MIB(64) } },
+		.imagesize = MIB(8),
+		.ok = true,
+		.target = DOWNLOAD_TARGET_TMPFS,
+		.path = "/tmp/firmware.bin",
+	},
+	{
+		/* The image would fit, but not along with the reserve */
+		.name = "storage fallback for memory",
+		.meminfo = "MemTotal: 28672 kB\nMemAvailable: 10240 kB\n",
+		.fs = { { "/tmp", MIB(32) }, { "/mnt/small", MIB(1) }, { "/mnt/large", MIB(64) } },
+		.imagesize = MIB(8),
+		.ok = true,
+		.target = DOWNLOAD_TARGET_STORAGE,
+		.path = "/mnt/large/firmware.bin",
+	},
+	{
+		.name = "storage fallback for tmpfs",
+		.meminfo = "MemTotal: 126976 kB\nMemAvailable: 65536 kB\n",
+		.fs = { { "/tmp", MIB(4) }, { "/mnt/small", MIB(1) }, { "/mnt/large", MIB(64) } },
+		.imagesize = MIB(8),
+		.ok = true,
+		.target = DOWNLOAD_TARGET_STORAGE,
+		.path = "/mnt/large/firmware.bin",
+	},
+	{
+		.name = "nothing fits",
+		.meminfo = "MemTotal: 28672 kB\nMemAvailable: 10240 kB\n",
+		.fs = { { "/tmp", MIB(32) }, { "/mnt/small", MIB(1) }, { "/mnt/large", MIB(2) } },
+		.imagesize = MIB(8),
+		.ok = false,
+		.target = DOWNLOAD_TARGET_NONE,
+		.path = "",
+	},
+};
+
+#define N_SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+
+static const struct scenario *current;
+
+static int64_t fs_available(const char *path) {
+	for (size_t i = 0; i < sizeof(current->fs) / sizeof(current->fs[0]); i++) {
+		if (current->fs[i].path && !strcmp(current->fs[i].path, path))
+			return current->fs[i].available;
+	}
+
+	return -1;
+}
+
+static bool write_meminfo(const char *path, const char *meminfo) {
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return false;
+
+	fputs(meminfo, f);
+	return !fclose(f);
+}
+
+int main(void) {
+	char meminfo_path[] = "/tmp/storage-test.XXXXXX";
+	int fd = mkstemp(meminfo_path);
+	if (fd < 0) {
+		perror("storage-test: unable to create meminfo file");
+		return 1;
+	}
+	close(fd);
+
+	const struct storage_env env = {
+		.meminfo_path = meminfo_path,
+		.tmp_dir = "/tmp",
+		.fs_available = fs_available,
+	};
+	bool ok = true;
+
+	for (size_t i = 0; i < N_SCENARIOS; i++) {
+		current = &scenarios[i];
+		if (!write_meminfo(meminfo_path, current->meminfo)) {
+			perror("storage-test: unable to write meminfo file");
+			ok = false;
+			break;
+		}
+
+		struct download_plan plan;
+		bool planned = plan_download(&plan, &env, current->imagesize, storage, sizeof(storage) / sizeof(storage[0]));
+
+		if (planned != current->ok || plan.target != current->target || strcmp(plan.path, current->path)) {
+			fprintf(stderr, "storage-test: %s: planned %s (target %i, '%s'), expected %s (target %i, '%s')\n",
+				current->name, planned ? "download" : "nothing", plan.target, plan.path,
+				current->ok ? "download" : "nothing", current->target, current->path);
+			ok = false;
+		}
+	}
+
+	unlink(meminfo_path);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/*
+ * Checks that the precomputed version keys of version.c order versions like
+ * newer_than() and prints how long sorting the versions of many neighbours
+ * takes, as on large wired backbone segments. Exits with status 1 if a pair
+ * of versions is ordered differently.
+ */
+
+
+#include "version.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define BENCHMARK_MAX_NEIGHBOURS 4096
+#define BENCHMARK_ROUNDS 16
+
+
+static const char *const releases[] = {
+	"v2023.2.3", "v2023.2.2", "v2023.2.3~rc1", "v2023.1", "v2022.1.4-5", "v2022.1.4-12",
+	"2021.1.2+exp20240301", "experimental-2024-03-01-1a2b3c", "v2023.2.03", "v2023.2.3.0",
+	"1.0", "1.", "1.0~", "1.0a", "1.a", "1~", "1", "", "a", "~", "007", "7",
+	"99999999999999999999999.1", "99999999999999999999998.2", "100000000000000000000000",
+};
+
+#define N_RELEASES (sizeof(releases) / sizeof(releases[0]))
+
+
+static int compare_strings_newest_first(const void *p1, const void *p2) {
+	const char *const *a = p1, *const *b = p2;
+
+	if (newer_than(*a, *b))
+		return -1;
+	if (newer_than(*b, *a))
+		return 1;
+	return 0;
+}
+
+static int compare_keys_newest_first(const void *p1, const void *p2) {
+	return version_key_compare(p2, p1);
+}
+
+/** Checks that the keys order all pairs of versions like newer_than() */
+static bool check(void) {
+	bool ok = true;
+
+	for (size_t i = 0; i < N_RELEASES; i++) {
+		struct version_key a;
+		version_key_init(&a, releases[i]);
+
+		for (size_t j = 0; j < N_RELEASES; j++) {
+			struct version_key b;
+			version_key_init(&b, releases[j]);
+
+			int expected = newer_than(releases[i], releases[j]) - newer_than(releases[j], releases[i]);
+			int cmp = version_key_compare(&a, &b);
+			version_key_free(&b);
+
+			if ((cmp > 0) - (cmp < 0) != expected) {
+				fprintf(stderr, "version-test: '%s' and '%s' are ordered differently\n", releases[i], releases[j]);
+				ok = false;
+			}
+		}
+
+		version_key_free(&a);
+	}
+
+	return ok;
+}
+
+int main(void) {
+	static const size_t sizes[] = { 16, 256, BENCHMARK_MAX_NEIGHBOURS };
+
+	bool ok = check();
+
+	const char **strings = safe_malloc(BENCHMARK_MAX_NEIGHBOURS * sizeof(*strings));
+	struct version_key *keys = safe_malloc(BENCHMARK_MAX_NEIGHBOURS * sizeof(*keys));
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		size_t n = sizes[i];
+		double strings_time = 0, keys_time = 0;
+
+		for (unsigned round = 0; round < BENCHMARK_ROUNDS; round++) {
+			/* Most nodes of a segment run one of the latest releases */
+			for (size_t k = 0; k < n; k++)
+				strings[k] = releases[rand() % 4 ? rand() % 3 : rand() % N_RELEASES];
+
+			double start = get_time();
+			qsort(strings, n, sizeof(*strings), compare_strings_newest_first);
+			strings_time += get_time() - start;
+
+			start = get_time();
+			for (size_t k = 0; k < n; k++)
+				version_key_init(&keys[k], strings[k]);
+			qsort(keys, n, sizeof(*keys), compare_keys_newest_first);
+			keys_time += get_time() - start;
+
+			for (size_t k = 0; k < n; k++)
+				version_key_free(&keys[k]);
+		}
+
+		printf("%4zu neighbours: %8.3f ms comparing strings, %8.3f ms comparing keys\n",
+		       n, strings_time * 1000 / BENCHMARK_ROUNDS, keys_time * 1000 / BENCHMARK_ROUNDS);
+	}
+
+	free(keys);
+	free(strings);
+
+	return ok ? 0 : 1;
+}
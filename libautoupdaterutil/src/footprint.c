@@ -0,0 +1,60 @@
+/*
+  Copyright (c) 2018, Tobias Schramm <tobleminer@gmail.com>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "footprint.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/resource.h>
+
+
+/**
+ * Reads the memory peaks the kernel keeps in /proc/self/status and the
+ * CPU time from getrusage()
+ */
+bool footprint_read(struct footprint *fp) {
+	memset(fp, 0, sizeof(*fp));
+
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage))
+		return false;
+
+	fp->cpu_user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+	fp->cpu_system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+
+	FILE *f = fopen("/proc/self/status", "r");
+	if (!f)
+		return false;
+
+	char line[128];
+	while (fgets(line, sizeof(line), f)) {
+		sscanf(line, "VmHWM: %lu", &fp->rss_peak);
+		sscanf(line, "VmPeak: %lu", &fp->vm_peak);
+	}
+
+	fclose(f);
+	return true;
+}
@@ -0,0 +1,169 @@
+/*
+  Copyright (c) 2012, Nils Schneider <nils@nilsschneider.net>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "hexutil.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define HEX_SIMD "SSE2"
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HEX_SIMD "NEON"
+#endif
+
+
+/* Value of each hexadecimal digit, 0xff for all other characters */
+static const uint8_t hex_values[256] = {
+	[0 ... 255] = 0xff,
+	['0'] = 0x0, ['1'] = 0x1, ['2'] = 0x2, ['3'] = 0x3, ['4'] = 0x4,
+	['5'] = 0x5, ['6'] = 0x6, ['7'] = 0x7, ['8'] = 0x8, ['9'] = 0x9,
+	['a'] = 0xa, ['b'] = 0xb, ['c'] = 0xc, ['d'] = 0xd, ['e'] = 0xe, ['f'] = 0xf,
+	['A'] = 0xa, ['B'] = 0xb, ['C'] = 0xc, ['D'] = 0xd, ['E'] = 0xe, ['F'] = 0xf,
+};
+
+
+static bool decode_table(unsigned char *output, const unsigned char *input, size_t len) {
+	uint8_t invalid = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		uint8_t hi = hex_values[input[2*i]], lo = hex_values[input[2*i + 1]];
+		invalid |= hi | lo;
+		output[i] = (hi << 4) | (lo & 0xf);
+	}
+
+	return !(invalid & 0xf0);
+}
+
+
+#if defined(__SSE2__)
+
+/** Converts 16 digits to their values, clearing the lanes of valid that are no digits */
+static inline __m128i nibbles_sse2(__m128i c, __m128i *valid) {
+	/* SSE2 only has signed byte comparisons, so every range check is done twice */
+	const __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	const __m128i letter = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	const __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(digit, _mm_set1_epi8(-1)),
+					       _mm_cmplt_epi8(digit, _mm_set1_epi8(10)));
+	const __m128i is_letter = _mm_and_si128(_mm_cmpgt_epi8(letter, _mm_set1_epi8(-1)),
+						_mm_cmplt_epi8(letter, _mm_set1_epi8(6)));
+
+	*valid = _mm_and_si128(*valid, _mm_or_si128(is_digit, is_letter));
+
+	return _mm_or_si128(_mm_and_si128(is_digit, digit),
+			    _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+/** Merges the two nibbles of each 16 bit lane into its low byte */
+static inline __m128i pairs_sse2(__m128i n) {
+	return _mm_or_si128(_mm_and_si128(_mm_slli_epi16(n, 4), _mm_set1_epi16(0xf0)), _mm_srli_epi16(n, 8));
+}
+
+/** Decodes the largest multiple of 16 bytes and returns their number */
+static size_t decode_simd(unsigned char *output, const unsigned char *input, size_t len, bool *ok) {
+	__m128i valid = _mm_set1_epi8(-1);
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i a = nibbles_sse2(_mm_loadu_si128((const __m128i *)&input[2*i]), &valid);
+		__m128i b = nibbles_sse2(_mm_loadu_si128((const __m128i *)&input[2*i + 16]), &valid);
+		_mm_storeu_si128((__m128i *)&output[i], _mm_packus_epi16(pairs_sse2(a), pairs_sse2(b)));
+	}
+
+	*ok = _mm_movemask_epi8(valid) == 0xffff;
+	return i;
+}
+
+#elif defined(HEX_SIMD)
+
+/** Converts 16 digits to their values, clearing the lanes of valid that are no digits */
+static inline uint8x16_t nibbles_neon(uint8x16_t c, uint8x16_t *valid) {
+	const uint8x16_t digit = vsubq_u8(c, vdupq_n_u8('0'));
+	const uint8x16_t letter = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+	const uint8x16_t is_digit = vcltq_u8(digit, vdupq_n_u8(10));
+	const uint8x16_t is_letter = vcltq_u8(letter, vdupq_n_u8(6));
+
+	*valid = vandq_u8(*valid, vorrq_u8(is_digit, is_letter));
+
+	return vbslq_u8(is_digit, digit, vaddq_u8(letter, vdupq_n_u8(10)));
+}
+
+/** Decodes the largest multiple of 16 bytes and returns their number */
+static size_t decode_simd(unsigned char *output, const unsigned char *input, size_t len, bool *ok) {
+	uint8x16_t valid = vdupq_n_u8(0xff);
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		/* Deinterleaves high and low digits */
+		uint8x16x2_t c = vld2q_u8(&input[2*i]);
+		uint8x16_t hi = nibbles_neon(c.val[0], &valid);
+		uint8x16_t lo = nibbles_neon(c.val[1], &valid);
+		vst1q_u8(&output[i], vorrq_u8(vshlq_n_u8(hi, 4), vandq_u8(lo, vdupq_n_u8(0xf))));
+	}
+
+	uint64x2_t v = vreinterpretq_u64_u8(valid);
+	*ok = (vgetq_lane_u64(v, 0) & vgetq_lane_u64(v, 1)) == UINT64_MAX;
+	return i;
+}
+
+#endif
+
+
+bool hexdecode(void *output, const char *input, size_t len) {
+	unsigned char *out = output;
+	const unsigned char *in = (const unsigned char *)input;
+	bool ok = true;
+
+#ifdef HEX_SIMD
+	size_t done = decode_simd(out, in, len, &ok);
+	out += done;
+	in += 2*done;
+	len -= done;
+#endif
+
+	return decode_table(out, in, len) && ok;
+}
+
+bool parsehex(void *output, const char *input, size_t len) {
+	// number of digits must be 2 * len
+	if (strnlen(input, 2*len + 1) != 2*len)
+		return false;
+
+	return hexdecode(output, input, len);
+}
+
+void formathex(char *output, const void *input, size_t len) {
+	static const char digits[] = "0123456789abcdef";
+	const unsigned char *buffer = input;
+
+	for (size_t i = 0; i < len; i++) {
+		output[2*i] = digits[buffer[i] >> 4];
+		output[2*i + 1] = digits[buffer[i] & 0xf];
+	}
+
+	output[2*len] = '\0';
+}
@@ -33,3 +33,14 @@
  * must fit exactly into the buffer.
  */
 bool parsehex(void *buffer, const char *string, size_t len);
+
+/* Decodes exactly 2 * len hexadecimal digits without requiring them to be
+ * followed by a NUL character. The digits must be readable. The contents of
+ * the buffer are unspecified if the function fails.
+ */
+bool hexdecode(void *buffer, const char *string, size_t len);
+
+/* Writes len bytes from the given buffer as 2 * len lowercase hexadecimal
+ * digits plus a terminating NUL character to string.
+ */
+void formathex(char *string, const void *buffer, size_t len);
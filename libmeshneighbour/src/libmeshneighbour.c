@@ -73,23 +73,39 @@ void mesh_free_respondd_neighbours_ctx(struct mesh_neighbour_ctx *ctx) {
 	gluonutil_free_interfaces(&ctx->interfaces);
 }
 
+/* Responses are collected for at most RESPONDD_TIMEOUT_MSEC on all interfaces together */
+#define RESPONDD_TIMEOUT_MSEC 3000
+/* Collection ends early once no response came in for RESPONDD_QUIET_MSEC */
+#define RESPONDD_QUIET_MSEC 1000
+
 struct mesh_respondd_ctx {
-	struct gluonutil_interface *iface;
+	struct list_head *interfaces;
 	struct list_head *neighbours;
+	struct timespec start;
 	void *cb_priv;
 	neighbour_cb cb;
 };
 
-static struct mesh_neighbour *find_neighbour_nodeid(const char *nodeid, const struct list_head *neighbours) {
+static struct mesh_neighbour *find_neighbour_nodeid(const char *nodeid, const struct gluonutil_interface *iface, const struct list_head *neighbours) {
 	struct mesh_neighbour *neighbour;
 	list_for_each_entry(neighbour, neighbours, list) {
-		if(!strcmp(nodeid, neighbour->nodeid)) {
+		if(neighbour->iface == iface && !strcmp(nodeid, neighbour->nodeid)) {
 			return neighbour;
 		}
 	}
 	return NULL;
 }
 
+static struct gluonutil_interface *find_up_interface(unsigned int ifindex, const struct list_head *interfaces) {
+	struct gluonutil_interface *iface;
+	list_for_each_entry(iface, interfaces, list) {
+		if(iface->up && iface->ifindex == ifindex) {
+			return iface;
+		}
+	}
+	return NULL;
+}
+
 static int mesh_respondd_cb(const char *json_data, size_t data_len, const struct librespondd_pkt_info *pktinfo, void *priv) {
 	// pktinfo not set, something is not right
 	if(!pktinfo->ifindex) {
@@ -98,6 +114,15 @@ static int mesh_respondd_cb(const char *json_data, size_t data_len, const struct
 
 	struct mesh_respondd_ctx *ctx = priv;
 
+	// Responses arriving on other interfaces are no neighbours of ours
+	struct gluonutil_interface *iface = find_up_interface(pktinfo->ifindex, ctx->interfaces);
+	if(!iface) {
+		goto out;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
 	struct json_object *json_root = json_tokener_parse(json_data);
 	if(!json_root) {
 		goto out;
@@ -113,7 +138,7 @@ static int mesh_respondd_cb(const char *json_data, size_t data_len, const struct
 		goto out_json;
 	}
 
-	if(find_neighbour_nodeid(nodeid, ctx->neighbours)) {
+	if(find_neighbour_nodeid(nodeid, iface, ctx->neighbours)) {
 		goto out_json;
 	}
 
@@ -129,8 +154,9 @@ static int mesh_respondd_cb(const char *json_data, size_t data_len, const struct
 		goto out_neighbour;
 	}
 
-	neighbour->iface = ctx->iface;
+	neighbour->iface = iface;
 	neighbour->addr = pktinfo->src_addr;
+	neighbour->rtt_us = (now.tv_sec - ctx->start.tv_sec) * 1000000 + (now.tv_nsec - ctx->start.tv_nsec) / 1000;
 
 	if(ctx->cb) {
 		if(ctx->cb(json_root, pktinfo, neighbour, ctx->cb_priv)) {
@@ -150,39 +176,55 @@ out:
 	return RESPONDD_CB_OK;
 }
 
+/*
+ * The query is sent on all interfaces at once, so discovery takes
+ * RESPONDD_TIMEOUT_MSEC at most, no matter how many interfaces there are.
+ */
 static int mesh_get_neighbours_respondd_interfaces(struct list_head *interfaces, struct list_head* neighbours, unsigned short respondd_port, neighbour_cb cb, void *priv) {
+	size_t num_dsts = 0;
 	struct gluonutil_interface *iface;
-	struct sockaddr_in6 sock_addr;
-	sock_addr.sin6_family = AF_INET6;
-	sock_addr.sin6_port = htons(respondd_port);
-	sock_addr.sin6_flowinfo = 0;
-	sock_addr.sin6_addr = IPV6_MCAST_ALL_NODES;
+	list_for_each_entry(iface, interfaces, list) {
+		if(iface->up) {
+			num_dsts++;
+		}
+	}
 
-	struct timeval timeout = { 3, 0 };
+	if(!num_dsts) {
+		return 0;
+	}
 
-	int err = 0;
+	struct sockaddr_in6 *dsts = calloc(num_dsts, sizeof(*dsts));
+	if(!dsts) {
+		return -ENOMEM;
+	}
+
+	size_t i = 0;
 	list_for_each_entry(iface, interfaces, list) {
 		if(!iface->up) {
 			continue;
 		}
 
-		sock_addr.sin6_scope_id = iface->ifindex;
+		dsts[i++] = (struct sockaddr_in6){
+			.sin6_family = AF_INET6,
+			.sin6_port = htons(respondd_port),
+			.sin6_addr = IPV6_MCAST_ALL_NODES,
+			.sin6_scope_id = iface->ifindex,
+		};
+	}
 
-		LIST_HEAD(neighbours_if);
+	const struct timeval timeout = { RESPONDD_TIMEOUT_MSEC / 1000, (RESPONDD_TIMEOUT_MSEC % 1000) * 1000 };
+	const struct timeval quiet = { RESPONDD_QUIET_MSEC / 1000, (RESPONDD_QUIET_MSEC % 1000) * 1000 };
 
-		struct mesh_respondd_ctx ctx = {
-			.iface = iface,
-			.neighbours = &neighbours_if,
-			.cb_priv = priv,
-			.cb = cb,
-		};
-		int ret = respondd_request(&sock_addr, "nodeinfo", &timeout, mesh_respondd_cb, &ctx);
-		if(ret) {
-			err = ret;
-		}
+	struct mesh_respondd_ctx ctx = {
+		.interfaces = interfaces,
+		.neighbours = neighbours,
+		.cb_priv = priv,
+		.cb = cb,
+	};
+	clock_gettime(CLOCK_MONOTONIC, &ctx.start);
+	int err = respondd_request_multi(dsts, num_dsts, "nodeinfo", &timeout, &quiet, mesh_respondd_cb, &ctx);
 
-		list_splice(&neighbours_if, neighbours);
-	}
+	free(dsts);
 
 	return err;
 }
@@ -218,3 +260,33 @@ int mesh_get_neighbours_respondd(struct mesh_neighbour_ctx *neigh_ctx, unsigned
 
         return err;
 }
+
+/*
+ * Discovery in two steps: the interfaces are looked up via ubus, which
+ * uses the global uloop and must happen on the thread owning it. Querying
+ * the neighbours doesn't touch uloop or ubus, so it may run on another
+ * thread while the uloop keeps running.
+ */
+int mesh_get_neighbour_interfaces(struct mesh_neighbour_ctx *neigh_ctx) {
+	struct ubus_context *ubus_ctx = ubus_connect(NULL);
+	if(!ubus_ctx) {
+		neigh_ctx->neighbours = (struct list_head)LIST_HEAD_INIT(neigh_ctx->neighbours);
+		neigh_ctx->interfaces = (struct list_head)LIST_HEAD_INIT(neigh_ctx->interfaces);
+		return -ECONNREFUSED;
+	}
+
+	int err = get_neighbours_common(ubus_ctx, neigh_ctx);
+
+	ubus_free(ubus_ctx);
+
+	return err;
+}
+
+/*
+ * Queries the neighbours on all interfaces found by mesh_get_neighbour_interfaces().
+ * Neighbours found are kept even if querying some interface failed, neigh_ctx
+ * must be freed with mesh_free_respondd_neighbours_ctx() in any case.
+ */
+int mesh_query_neighbours_respondd(struct mesh_neighbour_ctx *neigh_ctx, unsigned short respondd_port, neighbour_cb cb, void *priv) {
+	return mesh_get_neighbours_respondd_interfaces(&neigh_ctx->interfaces, &neigh_ctx->neighbours, respondd_port, cb, priv);
+}
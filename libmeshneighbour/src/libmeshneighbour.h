@@ -9,6 +9,8 @@ struct mesh_neighbour {
 	struct in6_addr addr;
 	struct gluonutil_interface *iface;
 	char *nodeid;
+	/* time from sending the query until the reply arrived */
+	unsigned long rtt_us;
 	void *priv;
 
 	struct list_head list;
@@ -19,10 +21,15 @@ struct mesh_neighbour_ctx {
 	struct list_head interfaces;
 };
 
+struct json_object;
+
 typedef int (*neighbour_cb)(struct json_object *json, const struct librespondd_pkt_info *pktinfo, struct mesh_neighbour *neigh, void* priv);
 
 int mesh_get_neighbours_respondd(struct mesh_neighbour_ctx *neigh_ctx, unsigned short respondd_port, neighbour_cb cb, void *priv);
 
+int mesh_get_neighbour_interfaces(struct mesh_neighbour_ctx *neigh_ctx);
+int mesh_query_neighbours_respondd(struct mesh_neighbour_ctx *neigh_ctx, unsigned short respondd_port, neighbour_cb cb, void *priv);
+
 void mesh_free_respondd_neighbours_ctx(struct mesh_neighbour_ctx *ctx);
 
 #endif
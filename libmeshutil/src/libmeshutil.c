@@ -170,6 +170,11 @@ fail:
 	return err;
 }
 
+static const char *const gluonutil_mesh_protocols[] = {
+	"gluon_mesh",
+	"gluon_wired",
+};
+
 static bool proto_is_mesh(char* proto) {
 	if(!proto) {
 		return false;
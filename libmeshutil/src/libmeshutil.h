@@ -42,11 +42,6 @@ struct gluonutil_interface {
 	struct list_head list;
 };
 
-char *gluonutil_mesh_protocols[] = {
-	"gluon_mesh",
-	"gluon_wired",
-};
-
 int gluonutil_get_mesh_interfaces(struct ubus_context* ubus_ctx, struct list_head *interfaces);
 void gluonutil_free_interfaces(struct list_head* interfaces);
 
@@ -91,20 +91,24 @@ static ssize_t recv_timeout(int sock, char *buff, size_t max_len, struct libresp
 	return recv_len;
 }
 
-static inline bool timeout_elapsed(struct timeval *timeout) {
-	return timeout->tv_sec < 0;
-}
-
-int respondd_request(const struct sockaddr_in6 *dst, const char* query, struct timeval *timeout_, respondd_cb callback, void *cb_priv) {
+/*
+ * Sends the query to every destination from a single socket and collects
+ * the responses of all of them until the deadline given by timeout. With a
+ * quiet period, collection ends early once that long has passed without a
+ * response since the last one. Destinations the query can't be sent to are
+ * skipped, the first error is returned after collecting the responses to
+ * the others.
+ */
+int respondd_request_multi(const struct sockaddr_in6 *dsts, size_t num_dsts, const char* query, const struct timeval *timeout, const struct timeval *quiet, respondd_cb callback, void *cb_priv) {
 	int err = 0;
 
-	struct timeval timeout, now, after;
-	timeout = *timeout_;
+	struct timeval now, deadline, quiet_deadline, wait;
 	getclock(&now);
+	timeradd(&now, timeout, &deadline);
 
 	int sock = socket(PF_INET6, SOCK_DGRAM, 0);
 	if(sock < 0) {
-		err = sock;
+		err = -errno;
 		goto fail;
 	}
 
@@ -114,31 +118,48 @@ int respondd_request(const struct sockaddr_in6 *dst, const char* query, struct t
 		goto fail_sock;
 	}
 
-	if(sendto(sock, query, strlen(query), 0, (struct sockaddr*)dst, sizeof(struct sockaddr_in6)) < 0) {
-		err = -errno;
-		goto fail_sock;
+	size_t num_sent = 0;
+	for(size_t i = 0; i < num_dsts; i++) {
+		if(sendto(sock, query, strlen(query), 0, (struct sockaddr*)&dsts[i], sizeof(struct sockaddr_in6)) < 0) {
+			if(!err) {
+				err = -errno;
+			}
+			continue;
+		}
+		num_sent++;
 	}
 
 	// Allow query-only usage
-	if(!callback) {
+	if(!callback || !num_sent) {
 		goto fail_sock;
 	}
 
 	// Add one extra byte to ensure NUL termination
 	char rx_buff[RX_BUFF_SIZE + 1];
 
-	getclock(&after);
-	timersub(&after, &after, &now);
-	timersub(&timeout, &timeout, &after);
-
+	bool responded = false;
 	struct librespondd_pkt_info pktinfo;
-	while(!timeout_elapsed(&timeout)) {
-		memset(rx_buff, 0, RX_BUFF_SIZE + 1);
+	while(true) {
 		getclock(&now);
 
+		const struct timeval *until = &deadline;
+		if(responded && timercmp(&quiet_deadline, &deadline, <)) {
+			until = &quiet_deadline;
+		}
+
+		if(!timercmp(&now, until, <)) {
+			break;
+		}
+		timersub(until, &now, &wait);
+
+		memset(rx_buff, 0, RX_BUFF_SIZE + 1);
 		memset(&pktinfo, 0, sizeof(pktinfo));
-		ssize_t recv_size = recv_timeout(sock, rx_buff, RX_BUFF_SIZE, &pktinfo, &timeout);
+		ssize_t recv_size = recv_timeout(sock, rx_buff, RX_BUFF_SIZE, &pktinfo, &wait);
 		if(recv_size < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
 			// Not an error, timeout elapsed
 			if(errno == EAGAIN) {
 				break;
@@ -153,6 +174,12 @@ int respondd_request(const struct sockaddr_in6 *dst, const char* query, struct t
 			break;
 		}
 
+		if(quiet) {
+			getclock(&now);
+			timeradd(&now, quiet, &quiet_deadline);
+			responded = true;
+		}
+
 		int res = callback(rx_buff, recv_size, &pktinfo, cb_priv);
 		if(res) {
 			if(res == RESPONDD_CB_CANCEL) {
@@ -161,10 +188,6 @@ int respondd_request(const struct sockaddr_in6 *dst, const char* query, struct t
 			err = res;
 			goto fail_sock;
 		}
-
-		getclock(&after);
-		timersub(&after, &after, &now);
-		timersub(&timeout, &timeout, &after);
 	}
 
 fail_sock:
@@ -172,3 +195,7 @@ fail_sock:
 fail:
 	return err;
 }
+
+int respondd_request(const struct sockaddr_in6 *dst, const char* query, struct timeval *timeout, respondd_cb callback, void *cb_priv) {
+	return respondd_request_multi(dst, 1, query, timeout, NULL, callback, cb_priv);
+}
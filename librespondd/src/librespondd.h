@@ -18,5 +18,6 @@ struct librespondd_pkt_info {
 typedef int (*respondd_cb)(const char* json_data, size_t data_len, const struct librespondd_pkt_info *pktinfo, void* priv);
 
 int respondd_request(const struct sockaddr_in6* dst, const char* query, struct timeval *timeout, respondd_cb callback, void* cb_priv);
+int respondd_request_multi(const struct sockaddr_in6* dsts, size_t num_dsts, const char* query, const struct timeval *timeout, const struct timeval *quiet, respondd_cb callback, void* cb_priv);
 
 #endif